@@ -1761,6 +1761,22 @@ struct bt_le_scan_recv_info {
 
 	/** Secondary advertising channel PHY. */
 	uint8_t secondary_phy;
+
+#if defined(CONFIG_BT_SCAN_COALESCE_RSSI)
+	/**
+	 * @brief Number of reports coalesced into this one.
+	 *
+	 * Includes this report. When greater than 1, @ref rssi is the
+	 * average over all of them.
+	 */
+	uint16_t reports;
+
+	/** Weakest signal strength of the coalesced reports. */
+	int8_t rssi_min;
+
+	/** Strongest signal strength of the coalesced reports. */
+	int8_t rssi_max;
+#endif /* CONFIG_BT_SCAN_COALESCE_RSSI */
 };
 
 /** Listener context for (LE) scanning. */
@@ -1775,6 +1791,28 @@ struct bt_le_scan_cb {
 	void (*recv)(const struct bt_le_scan_recv_info *info,
 		     struct net_buf_simple *buf);
 
+#if defined(CONFIG_BT_EXT_SCAN_FRAG_CB)
+	/**
+	 * @brief Extended advertising data fragment received callback.
+	 *
+	 * Called for every extended advertising report fragment as the
+	 * controller delivers it, before reassembly. The complete data is
+	 * still given to @ref recv afterwards if it fit in the reassembly
+	 * buffer. Fragments from different advertisers may interleave, and
+	 * info->addr is the address reported by the controller.
+	 *
+	 * @param info   Advertiser packet information.
+	 * @param buf    Buffer containing this fragment of the data.
+	 * @param status BT_HCI_LE_ADV_EVT_TYPE_DATA_STATUS_PARTIAL if more
+	 *               fragments follow, BT_HCI_LE_ADV_EVT_TYPE_DATA_STATUS_COMPLETE
+	 *               for the last one, or
+	 *               BT_HCI_LE_ADV_EVT_TYPE_DATA_STATUS_INCOMPLETE if the
+	 *               controller truncated the data here.
+	 */
+	void (*recv_frag)(const struct bt_le_scan_recv_info *info,
+			  struct net_buf_simple *buf, uint8_t status);
+#endif /* CONFIG_BT_EXT_SCAN_FRAG_CB */
+
 	/** @brief The scanner has stopped scanning after scan timeout. */
 	void (*timeout)(void);
 
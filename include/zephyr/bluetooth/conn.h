@@ -490,6 +490,59 @@ int bt_conn_get_remote_info(struct bt_conn *conn,
 int bt_conn_le_get_tx_power_level(struct bt_conn *conn,
 				  struct bt_conn_le_tx_power *tx_power_level);
 
+/** Connection TX priorities, see @kconfig{CONFIG_BT_CONN_TX_SCHED}.
+ *
+ *  The value is also the connection's weight when sharing controller
+ *  buffers with other connections that have data queued.
+ */
+enum bt_conn_tx_prio {
+	/** Throughput oriented traffic, e.g. object transfer */
+	BT_CONN_TX_PRIO_BULK = 1,
+	/** Default priority of new connections */
+	BT_CONN_TX_PRIO_DEFAULT = 2,
+	/** Latency sensitive traffic, e.g. HID or audio control */
+	BT_CONN_TX_PRIO_LATENCY = 4,
+};
+
+/** Connection TX scheduling statistics. */
+struct bt_conn_tx_stats {
+	/** Buffers currently queued for transmission */
+	uint32_t queued;
+	/** Highest number of queued buffers */
+	uint32_t queued_max;
+	/** Buffers taken off the queue */
+	uint32_t dequeued;
+	/** Mean time a buffer spent queued, in microseconds */
+	uint32_t delay_avg_us;
+	/** Times the connection was held back at its quota */
+	uint32_t throttles;
+	/** Controller buffers currently held by the connection */
+	uint16_t inflight;
+	/** Controller buffers the connection may hold at the moment */
+	uint16_t quota;
+};
+
+/** @brief Set the TX priority of a connection.
+ *
+ *  @param conn Connection object.
+ *  @param prio New priority.
+ *
+ *  @return Zero on success or (negative) error code on failure.
+ *  @return -ENOTSUP @kconfig{CONFIG_BT_CONN_TX_SCHED} is disabled.
+ */
+int bt_conn_tx_prio_set(struct bt_conn *conn, enum bt_conn_tx_prio prio);
+
+/** @brief Get the TX scheduling statistics of a connection.
+ *
+ *  @param conn Connection object.
+ *  @param stats Filled with a snapshot of the statistics.
+ *
+ *  @return Zero on success or (negative) error code on failure.
+ *  @return -ENOTSUP @kconfig{CONFIG_BT_CONN_TX_SCHED} is disabled.
+ */
+int bt_conn_tx_stats_get(struct bt_conn *conn,
+			 struct bt_conn_tx_stats *stats);
+
 /** @brief Update the connection parameters.
  *
  *  If the local device is in the peripheral role then updating the connection
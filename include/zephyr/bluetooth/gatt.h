@@ -18,6 +18,7 @@
  */
 
 #include <stddef.h>
+#include <sys/atomic.h>
 #include <sys/slist.h>
 #include <sys/types.h>
 #include <sys/util.h>
@@ -738,6 +739,11 @@ struct _bt_gatt_ccc {
 	 */
 	bool (*cfg_match)(struct bt_conn *conn,
 			  const struct bt_gatt_attr *attr);
+
+#if defined(CONFIG_BT_GATT_NOTIFY_FANOUT)
+	/** Connection indexes subscribed to notifications */
+	ATOMIC_DEFINE(_subscribers, CONFIG_BT_MAX_CONN);
+#endif /* CONFIG_BT_GATT_NOTIFY_FANOUT */
 };
 
 /** @brief Read Client Characteristic Configuration Attribute helper.
@@ -2970,6 +2970,32 @@ int bt_hci_register_vnd_evt_cb(bt_hci_vnd_evt_cb_t cb);
  */
 int bt_hci_le_rand(void *buffer, size_t len);
 
+/** HCI RX batching counters, see CONFIG_BT_RECV_BATCH. */
+struct bt_hci_rx_stats {
+	/** Buffers currently waiting in the RX queue */
+	uint32_t depth;
+	/** Highest RX queue depth seen */
+	uint32_t depth_max;
+	/** Number of RX batches processed */
+	uint32_t batches;
+	/** Number of buffers processed in those batches */
+	uint32_t bufs;
+	/** Size of the last batch */
+	uint32_t batch_last;
+	/** Size of the largest batch */
+	uint32_t batch_max;
+	/** Batches ended by a per-type budget rather than an empty queue */
+	uint32_t budget_hits;
+};
+
+/** @brief Get the HCI RX batching counters.
+ *
+ * @param stats Filled with a snapshot of the counters.
+ *
+ * @return 0 on success or -ENOTSUP if CONFIG_BT_RECV_BATCH is disabled.
+ */
+int bt_hci_rx_stats_get(struct bt_hci_rx_stats *stats);
+
 
 #ifdef __cplusplus
 }
@@ -197,6 +197,25 @@ struct bt_l2cap_le_chan {
 	struct k_work_delayable		rtx_work;
 	struct k_work_sync		rtx_sync;
 #endif
+
+#if defined(CONFIG_BT_L2CAP_CREDITS_ADAPTIVE)
+	/** Adaptive credit state, used internally by stack */
+	struct {
+		/* Credits the peer should hold */
+		uint16_t		target;
+		/* K-frames needed for an SDU of the RX MTU */
+		uint16_t		sdu_frames;
+		/* SDUs held by the application */
+		uint8_t			held;
+		/* K-frames received in the current window */
+		uint16_t		window_frames;
+		/* Start of the current window, in ms */
+		uint32_t		window_start;
+		uint32_t		frames;
+		uint32_t		rx_stalls;
+		uint32_t		tx_stalls;
+	} _credits;
+#endif /* CONFIG_BT_L2CAP_CREDITS_ADAPTIVE */
 };
 
 /** @def BT_L2CAP_LE_CHAN(_ch)
@@ -537,6 +556,32 @@ int bt_l2cap_chan_send(struct bt_l2cap_chan *chan, struct net_buf *buf);
 int bt_l2cap_chan_recv_complete(struct bt_l2cap_chan *chan,
 				struct net_buf *buf);
 
+/** @brief LE L2CAP channel credit statistics. */
+struct bt_l2cap_le_credit_stats {
+	/** Credits the peer currently holds */
+	uint16_t credits;
+	/** Credits the peer is meant to hold, 0 if not adapted */
+	uint16_t target;
+	/** Number of K-frames received */
+	uint32_t frames;
+	/** Number of times the peer used up all its credits */
+	uint32_t rx_stalls;
+	/** Number of times sending waited for credits from the peer */
+	uint32_t tx_stalls;
+};
+
+/** @brief Get the credit statistics of an LE L2CAP channel
+ *
+ *  Requires @kconfig{CONFIG_BT_L2CAP_CREDITS_ADAPTIVE}.
+ *
+ *  @param chan Channel object.
+ *  @param stats Statistics to fill in.
+ *
+ *  @return 0 in case of success or negative value in case of error.
+ */
+int bt_l2cap_chan_credit_stats_get(struct bt_l2cap_chan *chan,
+				   struct bt_l2cap_le_credit_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -220,7 +220,32 @@ irq_connect_dynamic(unsigned int irq, unsigned int priority,
  * @return An architecture-dependent lock-out key representing the
  *         "interrupt disable state" prior to the call.
  */
-#ifdef CONFIG_SMP
+#if defined(CONFIG_IRQ_LOCK_HOST_SPINLOCK)
+/* Per call site record, only filled in with CONFIG_IRQ_LOCK_STATS */
+struct z_irq_lock_site {
+	const char *func;
+	unsigned int line;
+	uint32_t count;
+	uint32_t contended;
+	uint32_t hold_max;
+	uint64_t hold_total;
+	struct z_irq_lock_site *next;
+};
+
+unsigned int z_irq_spin_lock(struct z_irq_lock_site *site);
+#if defined(CONFIG_IRQ_LOCK_STATS)
+void irq_lock_stats_dump(void);
+#define irq_lock() ({							\
+	static struct z_irq_lock_site __irq_site = {			\
+		.func = __func__,					\
+		.line = __LINE__,					\
+	};								\
+	z_irq_spin_lock(&__irq_site);					\
+})
+#else
+#define irq_lock() z_irq_spin_lock(NULL)
+#endif
+#elif defined(CONFIG_SMP)
 unsigned int z_smp_global_lock(void);
 #define irq_lock() z_smp_global_lock()
 #else
@@ -248,7 +273,10 @@ unsigned int z_smp_global_lock(void);
  *
  * @param key Lock-out key generated by irq_lock().
  */
-#ifdef CONFIG_SMP
+#if defined(CONFIG_IRQ_LOCK_HOST_SPINLOCK)
+void z_irq_spin_unlock(unsigned int key);
+#define irq_unlock(key) z_irq_spin_unlock(key)
+#elif defined(CONFIG_SMP)
 void z_smp_global_unlock(unsigned int key);
 #define irq_unlock(key) z_smp_global_unlock(key)
 #else
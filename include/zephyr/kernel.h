@@ -1683,6 +1683,8 @@ static inline uint64_t k_cycle_get_64(void)
 struct k_queue {
 	sys_sflist_t data_q;
 	struct k_spinlock lock;
+	/* Items appended but not yet moved to data_q, newest first. */
+	sys_sfnode_t *inbox;
 
 	_POLL_EVENT;
 
@@ -1693,6 +1695,7 @@ struct k_queue {
 	{ \
 	.data_q = SYS_SFLIST_STATIC_INIT(&obj.data_q), \
 	.lock = { }, \
+	.inbox = NULL, \
 	_POLL_EVENT_OBJ_INIT(obj)		\
 	}
 
@@ -1917,11 +1920,6 @@ bool k_queue_unique_append(struct k_queue *queue, void *data);
  */
 __syscall int k_queue_is_empty(struct k_queue *queue);
 
-static inline int z_impl_k_queue_is_empty(struct k_queue *queue)
-{
-	return (int)sys_sflist_is_empty(&queue->data_q);
-}
-
 /**
  * @brief Peek element at the head of queue.
  *
@@ -3622,11 +3620,7 @@ enum {
 
 /** @brief A structure used to submit work. */
 struct k_work {
-#if defined(CONFIG_ZEPHYR_WORK_QUEUE)
-		struct wdog_s wdog;
-#else
-		struct work_s nwork;
-#endif
+	struct wdog_s wdog;
 
 	/* All fields are protected by the work module spinlock.  No fields
 	 * are to be accessed except through kernel API.
@@ -4925,8 +4919,10 @@ struct k_mem_slab {
 	uint32_t num_blocks;
 	size_t block_size;
 	char *buffer;
-	char *free_list;
+	atomic_t free_head;
+	atomic_t waiters;
 	uint32_t num_used;
+	uint32_t num_failed;
 #ifdef CONFIG_MEM_SLAB_TRACE_MAX_UTILIZATION
 	uint32_t max_used;
 #endif
@@ -4942,8 +4938,10 @@ struct k_mem_slab {
 	.num_blocks = slab_num_blocks, \
 	.block_size = slab_block_size, \
 	.buffer = slab_buffer, \
-	.free_list = NULL, \
+	.free_head = ATOMIC_INIT(-1), \
+	.waiters = ATOMIC_INIT(0), \
 	.num_used = 0, \
+	.num_failed = 0, \
 	}
 
 
@@ -5105,6 +5103,21 @@ static inline uint32_t k_mem_slab_max_used_get(struct k_mem_slab *slab)
 #endif
 }
 
+/**
+ * @brief Get the number of failed allocations in a memory slab.
+ *
+ * This routine gets the number of k_mem_slab_alloc() calls on @a slab
+ * that returned without a block, either immediately or after timing out.
+ *
+ * @param slab Address of the memory slab.
+ *
+ * @return Number of failed allocations.
+ */
+static inline uint32_t k_mem_slab_num_failed_get(struct k_mem_slab *slab)
+{
+	return slab->num_failed;
+}
+
 /**
  * @brief Get the number of unused blocks in a memory slab.
  *
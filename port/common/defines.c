@@ -589,9 +589,7 @@ const struct init_entry * const _init_entry_list[] =
 	&__init_sys_init_bt_native_init,
 #endif
 #endif /* CONFIG_BT_HCI */
-#if defined(CONFIG_ZEPHYR_WORK_QUEUE)
 	&__init_sys_init_k_sys_work_q_init,
-#endif /* CONFIG_ZEPHYR_WORK_QUEUE */
 	NULL,
 };
 /* kernel END */
@@ -44,12 +44,7 @@
 #include "bluetooth/bluetooth.h"
 #include "drivers/bluetooth/hci_driver.h"
 
-#define H4_NONE 0x00
-#define H4_CMD  0x01
-#define H4_ACL  0x02
-#define H4_SCO  0x03
-#define H4_EVT  0x04
-#define H4_ISO  0x05
+#include "h4_common.h"
 
 //#define HCI_DEBUG
 
@@ -59,6 +54,12 @@ static struct file            g_filep;
 #ifdef CONFIG_SMP
 static pthread_mutex_t        g_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
 #endif
+#if CONFIG_BT_H4_RX_BUF_SIZE > 0
+static uint8_t                g_rx_data[CONFIG_BT_H4_RX_BUF_SIZE];
+#else
+#define g_rx_data             NULL
+#endif
+static struct h4_rx_buf       g_rx;
 
 #ifdef CONFIG_BT_H4_DEBUG
 static void h4_data_dump(const char *tag, uint8_t type, uint8_t *data, uint32_t len)
@@ -74,265 +75,124 @@ static void h4_data_dump(const char *tag, uint8_t type, uint8_t *data, uint32_t
 }
 #endif
 
-static int h4_recv_data(uint8_t *buf, size_t count)
+static inline void h4_lock(void)
 {
-	ssize_t ret, nread = 0;
-
-	while (count != nread) {
-		ret = file_read(&g_filep, buf + nread, count - nread);
-		if (ret < 0) {
-			return ret;
-		}
-
-		nread += ret;
-	}
-
-	return nread;
+#ifdef CONFIG_SMP
+	pthread_mutex_lock(&g_mutex);
+#endif
 }
 
-static int h4_send_data(uint8_t *buf, size_t count)
+static inline void h4_unlock(void)
 {
-	ssize_t ret, nwritten = 0;
+#ifdef CONFIG_SMP
+	pthread_mutex_unlock(&g_mutex);
+#endif
+}
 
-	while (nwritten != count) {
-		ret = file_write(&g_filep, buf + nwritten, count - nwritten);
-		if (ret < 0) {
-			return ret;
-		}
+static ssize_t h4_file_read(void *ctx, uint8_t *buf, size_t len)
+{
+	return file_read(ctx, buf, len);
+}
 
-		nwritten += ret;
+static ssize_t h4_file_writev(void *ctx, const struct iovec *iov, int iovcnt)
+{
+	if (iovcnt == 1) {
+		return file_write(ctx, iov->iov_base, iov->iov_len);
 	}
 
-	return nwritten;
+	return file_writev(ctx, iov, iovcnt);
 }
-#ifdef CONFIG_SMP
-static void h4_rx_thread(void *p1, void *p2, void *p3)
+
+static struct net_buf *h4_get_rx(const struct h4_rx_hdr *hdr)
 {
-	unsigned char buffer[1];
-	int hdr_len, data_len, ret;
 	struct net_buf *buf;
-	bool discardable;
-	uint8_t type;
-	uint8_t event;
-	union {
-		struct bt_hci_evt_hdr evt;
-		struct bt_hci_acl_hdr acl;
-		struct bt_hci_iso_hdr iso;
-	} hdr;
-	pthread_mutex_lock(&g_mutex);
-	for (;;) {
-		pthread_mutex_unlock(&g_mutex);
-		ret = h4_recv_data(&type, 1);
-		pthread_mutex_lock(&g_mutex);
-		if (ret != 1)
-			break;
-
-		if (type != H4_EVT &&
-		    type != H4_ACL &&
-		    type != H4_ISO)
-			continue;
-
-		if (type == H4_EVT)
-			hdr_len = sizeof(struct bt_hci_evt_hdr);
-		else if (type == H4_ACL)
-			hdr_len = sizeof(struct bt_hci_acl_hdr);
-		else if (IS_ENABLED(CONFIG_BT_ISO) && type == H4_ISO)
-			hdr_len = sizeof(struct bt_hci_iso_hdr);
-		else
-			continue;
-
-		ret = h4_recv_data((uint8_t *)&hdr, hdr_len);
-		if (ret != hdr_len)
-			break;
-
-		if (type == H4_EVT) {
-			data_len = hdr.evt.len;
-			discardable = false;
-			if (hdr.evt.evt == BT_HCI_EVT_LE_META_EVENT) {
-				ret = h4_recv_data(&event, 1);
-				if (ret != 1)
-					break;
-
-				if (event == BT_HCI_EVT_LE_ADVERTISING_REPORT ||
-				    event == BT_HCI_EVT_LE_EXT_ADVERTISING_REPORT)
-					discardable = true;
-			}
-
-			buf = bt_buf_get_evt(hdr.evt.evt, discardable,
-					     discardable ? K_NO_WAIT : K_FOREVER);
-			if (buf == NULL) {
-				if (discardable && data_len) {
-					while(--data_len) {
-						h4_recv_data(buffer, 1);
-					}
-
-					continue;
-				} else
-					break;
-			}
-
-			memcpy(buf->data, &hdr, hdr_len);
-
-			if (hdr.evt.evt == BT_HCI_EVT_LE_META_EVENT) {
-				buf->data[sizeof(struct bt_hci_evt_hdr)] = event;
-				hdr_len += 1;
-				data_len -= 1;
-			}
 
+	switch (hdr->type) {
+	case H4_EVT:
+		buf = bt_buf_get_evt(hdr->hdr.evt.evt, hdr->discardable,
+				     hdr->discardable ? K_NO_WAIT : K_FOREVER);
+		if (buf) {
 			bt_buf_set_type(buf, BT_BUF_EVT);
-		} else if (type == H4_ACL) {
-			buf = bt_buf_get_rx(BT_BUF_ACL_IN, K_FOREVER);
-			if (buf == NULL)
-				break;
-
-			data_len = hdr.acl.len;
-			bt_buf_set_type(buf, BT_BUF_ACL_IN);
-			memcpy(buf->data, &hdr, hdr_len);
-		} else if (IS_ENABLED(CONFIG_BT_ISO) && type == H4_ISO) {
-			buf = bt_buf_get_rx(BT_BUF_ISO_IN, K_FOREVER);
-			if (buf == NULL)
-				break;
-
-			data_len = hdr.iso.len;
-			bt_buf_set_type(buf, BT_BUF_ISO_IN);
-			memcpy(buf->data, &hdr, hdr_len);
-		} else
-			break;
-
-
-		if (data_len + hdr_len > buf->size) {
-			net_buf_unref(buf);
-			continue;
 		}
-
-		ret = h4_recv_data(buf->data + hdr_len, data_len);
-		if (ret != data_len)
-			break;
-
-		net_buf_add(buf, hdr_len + data_len);
-
-#ifdef CONFIG_BT_H4_DEBUG
-		h4_data_dump("BT RX", type, buf->data, hdr_len + data_len);
-#endif
-		pthread_mutex_unlock(&g_mutex);
-		bt_recv(buf);
-		pthread_mutex_lock(&g_mutex);
+		return buf;
+	case H4_ACL:
+		return bt_buf_get_rx(BT_BUF_ACL_IN, K_FOREVER);
+	case H4_ISO:
+		return bt_buf_get_rx(BT_BUF_ISO_IN, K_FOREVER);
+	default:
+		return NULL;
 	}
-	pthread_mutex_unlock(&g_mutex);
-	BT_ASSERT(false);
 }
-#else
+
 static void h4_rx_thread(void *p1, void *p2, void *p3)
 {
-	unsigned char buffer[1];
-	int hdr_len, data_len, ret;
+	struct h4_rx_hdr hdr;
 	struct net_buf *buf;
-	bool discardable;
-	uint8_t type;
-	uint8_t event;
-	union {
-		struct bt_hci_evt_hdr evt;
-		struct bt_hci_acl_hdr acl;
-		struct bt_hci_iso_hdr iso;
-	} hdr;
+	bool idle;
+	int ret;
 
+	h4_lock();
 	for (;;) {
-		ret = h4_recv_data(&type, 1);
-		if (ret != 1)
-			break;
+		/* Only drop the lock when the next header has to come from
+		 * the transport rather than from the RX buffer.
+		 */
+		idle = !g_rx.len;
+		if (idle)
+			h4_unlock();
 
-		if (type != H4_EVT &&
-		    type != H4_ACL &&
-		    type != H4_ISO)
-			continue;
+		ret = h4_rx_hdr_read(&g_rx, &hdr);
 
-		if (type == H4_EVT)
-			hdr_len = sizeof(struct bt_hci_evt_hdr);
-		else if (type == H4_ACL)
-			hdr_len = sizeof(struct bt_hci_acl_hdr);
-		else if (IS_ENABLED(CONFIG_BT_ISO) && type == H4_ISO)
-			hdr_len = sizeof(struct bt_hci_iso_hdr);
-		else
-			continue;
+		if (idle)
+			h4_lock();
 
-		ret = h4_recv_data((uint8_t *)&hdr, hdr_len);
-		if (ret != hdr_len)
+		if (ret == -EAGAIN)
+			continue;
+		else if (ret < 0)
 			break;
 
-		if (type == H4_EVT) {
-			data_len = hdr.evt.len;
-			discardable = false;
-			if (hdr.evt.evt == BT_HCI_EVT_LE_META_EVENT) {
-				ret = h4_recv_data(&event, 1);
-				if (ret != 1)
+		buf = h4_get_rx(&hdr);
+		if (buf == NULL) {
+			if (hdr.discardable) {
+				ret = h4_rx_skip(&g_rx, hdr.data_len);
+				if (ret < 0)
 					break;
 
-				if (event == BT_HCI_EVT_LE_ADVERTISING_REPORT ||
-				    event == BT_HCI_EVT_LE_EXT_ADVERTISING_REPORT)
-					discardable = true;
+				continue;
 			}
 
-			buf = bt_buf_get_evt(hdr.evt.evt, discardable,
-					     discardable ? K_NO_WAIT : K_FOREVER);
-			if (buf == NULL) {
-				if (discardable && data_len) {
-					while(--data_len) {
-						h4_recv_data(buffer, 1);
-					}
-
-					continue;
-				} else
-					break;
-			}
-
-			memcpy(buf->data, &hdr, hdr_len);
-
-			if (hdr.evt.evt == BT_HCI_EVT_LE_META_EVENT) {
-				buf->data[sizeof(struct bt_hci_evt_hdr)] = event;
-				hdr_len += 1;
-				data_len -= 1;
-			}
-
-			bt_buf_set_type(buf, BT_BUF_EVT);
-		} else if (type == H4_ACL) {
-			buf = bt_buf_get_rx(BT_BUF_ACL_IN, K_FOREVER);
-			if (buf == NULL)
-				break;
-
-			data_len = hdr.acl.len;
-			bt_buf_set_type(buf, BT_BUF_ACL_IN);
-			memcpy(buf->data, &hdr, hdr_len);
-		} else if (IS_ENABLED(CONFIG_BT_ISO) && type == H4_ISO) {
-			buf = bt_buf_get_rx(BT_BUF_ISO_IN, K_FOREVER);
-			if (buf == NULL)
-				break;
-
-			data_len = hdr.iso.len;
-			bt_buf_set_type(buf, BT_BUF_ISO_IN);
-			memcpy(buf->data, &hdr, hdr_len);
-		} else
 			break;
+		}
 
-
-		if (data_len + hdr_len > buf->size) {
+		if (hdr.data_len + hdr.hdr_len > net_buf_tailroom(buf)) {
 			net_buf_unref(buf);
+			ret = h4_rx_skip(&g_rx, hdr.data_len);
+			if (ret < 0)
+				break;
+
 			continue;
 		}
 
-		ret = h4_recv_data(buf->data + hdr_len, data_len);
-		if (ret != data_len)
+		memcpy(buf->data, hdr.hdr.raw, hdr.hdr_len);
+
+		ret = h4_rx_read(&g_rx, buf->data + hdr.hdr_len, hdr.data_len);
+		if (ret < 0) {
+			net_buf_unref(buf);
 			break;
+		}
 
-		net_buf_add(buf, hdr_len + data_len);
+		net_buf_add(buf, hdr.hdr_len + hdr.data_len);
 
 #ifdef CONFIG_BT_H4_DEBUG
-		h4_data_dump("BT RX", type, buf->data, hdr_len + data_len);
+		h4_data_dump("BT RX", hdr.type, buf->data, buf->len);
 #endif
+		h4_unlock();
 		bt_recv(buf);
+		h4_lock();
 	}
+	h4_unlock();
 	BT_ASSERT(false);
 }
-#endif
+
 static int h4_open(void)
 {
 	int ret;
@@ -341,6 +201,9 @@ static int h4_open(void)
 	if (ret < 0)
 		goto bail;
 
+	h4_rx_buf_init(&g_rx, h4_file_read, &g_filep,
+		       g_rx_data, CONFIG_BT_H4_RX_BUF_SIZE);
+
 	ret = (int)k_thread_create(&rx_thread_data, rx_thread_stack,
 			K_THREAD_STACK_SIZEOF(rx_thread_stack),
 			h4_rx_thread, NULL, NULL, NULL,
@@ -382,42 +245,24 @@ static int h4_send(struct net_buf *buf)
 			type = H4_ISO;
 			break;
 		default:
-			ret = -EINVAL;
-			goto bail;
+			return -EINVAL;
 	}
 
 #ifdef CONFIG_BT_H4_DEBUG
 	h4_data_dump("BT TX", type, buf->data, buf->len);
 #endif
 
-#ifdef CONFIG_SMP
-	pthread_mutex_lock(&g_mutex);
-#endif
-	ret = h4_send_data(&type, 1);
-        if (ret < 0) {
-            goto out;
-        } else if (ret != 1) {
-            ret = -EINVAL;
-            goto out;
-        }
-
-        ret = h4_send_data(buf->data, buf->len);
-        if (ret < 0) {
-            goto out;
-        } else if (ret != buf->len) {
-            ret = -EINVAL;
-            goto out;
-        }
-
-out:
-#ifdef CONFIG_SMP
-	pthread_mutex_unlock(&g_mutex);
-#endif
+	h4_lock();
+	ret = h4_tx_send(buf, type, h4_file_writev, &g_filep);
+	h4_unlock();
+
+	if (ret < 0) {
+		return ret;
+	}
 
-bail:
 	net_buf_unref(buf);
 
-	return ret < 0 ? ret : 0;
+	return 0;
 }
 
 static struct bt_hci_driver driver = {
@@ -0,0 +1,251 @@
+/****************************************************************************
+ *
+ *   Copyright (C) 2020 Xiaomi InC. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include <kernel.h>
+#include <sys/util.h>
+#include <sys/byteorder.h>
+
+#include "h4_common.h"
+
+ssize_t h4_rx_read(struct h4_rx_buf *rx, uint8_t *dst, size_t len)
+{
+	uint8_t scratch[32];
+	size_t left = len;
+	size_t chunk;
+	ssize_t ret;
+
+	while (left) {
+		if (!rx->len) {
+			/* Payloads that would not fit anyway, and everything
+			 * in unbuffered mode, skip the staging copy.
+			 */
+			if (!rx->size || (dst && left >= rx->size)) {
+				chunk = dst ? left : MIN(left, sizeof(scratch));
+				ret = rx->read(rx->ctx, dst ? dst : scratch, chunk);
+				if (ret <= 0) {
+					return ret < 0 ? ret : -EIO;
+				}
+
+				if (dst) {
+					dst += ret;
+				}
+
+				left -= ret;
+				continue;
+			}
+
+			ret = rx->read(rx->ctx, rx->data, rx->size);
+			if (ret <= 0) {
+				return ret < 0 ? ret : -EIO;
+			}
+
+			rx->off = 0;
+			rx->len = ret;
+		}
+
+		chunk = MIN(left, rx->len);
+		if (dst) {
+			memcpy(dst, rx->data + rx->off, chunk);
+			dst += chunk;
+		}
+
+		rx->off += chunk;
+		rx->len -= chunk;
+		left    -= chunk;
+	}
+
+	return len;
+}
+
+int h4_rx_hdr_read(struct h4_rx_buf *rx, struct h4_rx_hdr *hdr)
+{
+	uint8_t subevent;
+	ssize_t ret;
+
+	ret = h4_rx_read(rx, &hdr->type, 1);
+	if (ret < 0) {
+		return ret;
+	}
+
+	switch (hdr->type) {
+	case H4_EVT:
+		hdr->hdr_len = sizeof(struct bt_hci_evt_hdr);
+		break;
+	case H4_ACL:
+		hdr->hdr_len = sizeof(struct bt_hci_acl_hdr);
+		break;
+	case H4_ISO:
+		if (IS_ENABLED(CONFIG_BT_ISO)) {
+			hdr->hdr_len = sizeof(struct bt_hci_iso_hdr);
+			break;
+		}
+		__fallthrough;
+	default:
+		return -EAGAIN;
+	}
+
+	ret = h4_rx_read(rx, hdr->hdr.raw, hdr->hdr_len);
+	if (ret < 0) {
+		return ret;
+	}
+
+	hdr->discardable = false;
+
+	switch (hdr->type) {
+	case H4_EVT:
+		hdr->data_len = hdr->hdr.evt.len;
+		if (hdr->hdr.evt.evt != BT_HCI_EVT_LE_META_EVENT ||
+		    !hdr->data_len) {
+			break;
+		}
+
+		ret = h4_rx_read(rx, &subevent, 1);
+		if (ret < 0) {
+			return ret;
+		}
+
+		hdr->hdr.raw[hdr->hdr_len++] = subevent;
+		hdr->data_len--;
+
+		if (subevent == BT_HCI_EVT_LE_ADVERTISING_REPORT ||
+		    subevent == BT_HCI_EVT_LE_EXT_ADVERTISING_REPORT) {
+			hdr->discardable = true;
+		}
+		break;
+	case H4_ACL:
+		hdr->data_len = sys_le16_to_cpu(hdr->hdr.acl.len);
+		break;
+	case H4_ISO:
+		hdr->data_len = bt_iso_hdr_len(sys_le16_to_cpu(hdr->hdr.iso.len));
+		break;
+	}
+
+	return 0;
+}
+
+bool h4_rx_in_place(uint8_t type, const uint8_t *data, size_t len)
+{
+	switch (type) {
+	case H4_ACL:
+		return !IS_ENABLED(CONFIG_BT_HCI_ACL_FLOW_CONTROL);
+	case H4_EVT:
+		if (!len) {
+			return false;
+		}
+
+		switch (data[0]) {
+		case BT_HCI_EVT_NUM_COMPLETED_PACKETS:
+		case BT_HCI_EVT_CMD_COMPLETE:
+		case BT_HCI_EVT_CMD_STATUS:
+			return false;
+#if defined(CONFIG_BT_BUF_EVT_DISCARDABLE_COUNT)
+		case BT_HCI_EVT_LE_META_EVENT:
+			return len > 2 &&
+			       data[2] != BT_HCI_EVT_LE_ADVERTISING_REPORT &&
+			       data[2] != BT_HCI_EVT_LE_EXT_ADVERTISING_REPORT;
+#endif
+		default:
+			return true;
+		}
+	default:
+		return false;
+	}
+}
+
+int h4_tx_send(struct net_buf *buf, uint8_t type, h4_tx_writev_t writev,
+	       void *ctx)
+{
+	struct iovec iov[H4_TX_IOV_MAX];
+	struct iovec *cur = iov;
+	struct net_buf *frag;
+	bool pushed = false;
+	int iovcnt = 0;
+	ssize_t ret;
+
+	if (net_buf_headroom(buf)) {
+		net_buf_push_u8(buf, type);
+		pushed = true;
+	} else {
+		iov[iovcnt].iov_base = &type;
+		iov[iovcnt].iov_len  = 1;
+		iovcnt++;
+	}
+
+	for (frag = buf; frag; frag = frag->frags) {
+		if (!frag->len) {
+			continue;
+		}
+
+		if (iovcnt == ARRAY_SIZE(iov)) {
+			ret = -ENOBUFS;
+			goto out;
+		}
+
+		iov[iovcnt].iov_base = frag->data;
+		iov[iovcnt].iov_len  = frag->len;
+		iovcnt++;
+	}
+
+	while (iovcnt) {
+		ret = writev(ctx, cur, iovcnt);
+		if (ret < 0) {
+			goto out;
+		} else if (ret == 0) {
+			ret = -EIO;
+			goto out;
+		}
+
+		/* Short write, resume where the transport stopped */
+		while (iovcnt && (size_t)ret >= cur->iov_len) {
+			ret -= cur->iov_len;
+			cur++;
+			iovcnt--;
+		}
+
+		if (iovcnt) {
+			cur->iov_base = (uint8_t *)cur->iov_base + ret;
+			cur->iov_len -= ret;
+		}
+	}
+
+	ret = 0;
+
+out:
+	if (pushed) {
+		net_buf_pull(buf, 1);
+	}
+
+	return ret;
+}
@@ -0,0 +1,139 @@
+/****************************************************************************
+ *
+ *   Copyright (C) 2020 Xiaomi InC. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef __PORT_DRIVERS_BLUETOOTH_HCI_H4_COMMON_H
+#define __PORT_DRIVERS_BLUETOOTH_HCI_H4_COMMON_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <net/buf.h>
+#include <bluetooth/hci.h>
+
+#define H4_NONE 0x00
+#define H4_CMD  0x01
+#define H4_ACL  0x02
+#define H4_SCO  0x03
+#define H4_EVT  0x04
+#define H4_ISO  0x05
+
+/* Indicator byte plus the fragments of one outgoing net_buf chain */
+#define H4_TX_IOV_MAX 8
+
+/* Blocking byte source the RX buffer refills from (file_read, read, ...) */
+typedef ssize_t (*h4_rx_read_t)(void *ctx, uint8_t *buf, size_t len);
+
+/* Staging buffer for the H:4 receive path.
+ *
+ * Each refill asks the transport for as many bytes as fit in @data, so one
+ * read usually carries several HCI packets which are then framed out of
+ * memory. With @size set to zero every request goes straight to @read,
+ * which matches the old one-read-per-field behaviour.
+ */
+struct h4_rx_buf {
+	h4_rx_read_t read;
+	void        *ctx;
+	uint8_t     *data;
+	size_t       size;
+	size_t       off;
+	size_t       len;
+};
+
+/* H:4 packet header as framed by h4_rx_hdr_read() */
+struct h4_rx_hdr {
+	uint8_t  type;
+	/* Valid bytes in hdr[], including the LE meta subevent if any */
+	uint8_t  hdr_len;
+	/* Payload bytes still to be read after hdr[] */
+	uint16_t data_len;
+	/* LE advertising reports which may be dropped under pressure */
+	bool     discardable;
+	union {
+		struct bt_hci_evt_hdr evt;
+		struct bt_hci_acl_hdr acl;
+		struct bt_hci_iso_hdr iso;
+		uint8_t raw[sizeof(struct bt_hci_iso_hdr) + 1];
+	} hdr;
+};
+
+static inline void h4_rx_buf_init(struct h4_rx_buf *rx, h4_rx_read_t read,
+				  void *ctx, uint8_t *data, size_t size)
+{
+	rx->read = read;
+	rx->ctx  = ctx;
+	rx->data = data;
+	rx->size = data ? size : 0;
+	rx->off  = 0;
+	rx->len  = 0;
+}
+
+/* Copy exactly @len bytes into @dst, or drop them when @dst is NULL.
+ * Returns @len on success or a negative error from the byte source.
+ */
+ssize_t h4_rx_read(struct h4_rx_buf *rx, uint8_t *dst, size_t len);
+
+static inline ssize_t h4_rx_skip(struct h4_rx_buf *rx, size_t len)
+{
+	return h4_rx_read(rx, NULL, len);
+}
+
+/* Read the packet indicator and header of the next H:4 packet.
+ * Returns 0 on success, -EAGAIN for an unsupported indicator byte which the
+ * caller should just skip, or a negative transport error.
+ */
+int h4_rx_hdr_read(struct h4_rx_buf *rx, struct h4_rx_hdr *hdr);
+
+/* Whether a packet of H:4 @type, starting with @data, belongs in a buffer
+ * from bt_buf_get_rx(BT_BUF_EVT). Drivers which receive into such a buffer
+ * before knowing the packet type can then deliver it without copying;
+ * otherwise it has to be moved into the buffer bt_buf_get_evt() returns.
+ */
+bool h4_rx_in_place(uint8_t type, const uint8_t *data, size_t len);
+
+/* Vectored sink for the H:4 transmit path, may write less than asked */
+typedef ssize_t (*h4_tx_writev_t)(void *ctx, const struct iovec *iov,
+				  int iovcnt);
+
+/* Send @buf and all of its fragments as one H:4 packet of indicator @type.
+ *
+ * The indicator is pushed into the buffer headroom when there is room so a
+ * plain, unfragmented buffer goes out as a single contiguous write.
+ * Returns 0 on success or a negative error, in which case @buf is left
+ * untouched and still owned by the caller.
+ */
+int h4_tx_send(struct net_buf *buf, uint8_t type, h4_tx_writev_t writev,
+	       void *ctx);
+
+#endif /* __PORT_DRIVERS_BLUETOOTH_HCI_H4_COMMON_H */
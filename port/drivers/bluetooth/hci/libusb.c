@@ -49,11 +49,7 @@
 #include "drivers/bluetooth/hci_driver.h"
 #include "common/log.h"
 
-#define H4_NONE              0x00
-#define H4_CMD               0x01
-#define H4_ACL               0x02
-#define H4_SCO               0x03
-#define H4_EVT               0x04
+#include "h4_common.h"
 
 #define HCI_BUFSIZE          800
 
@@ -62,26 +58,49 @@
 static K_THREAD_STACK_DEFINE(rx_thread_stack, CONFIG_BT_RX_STACK_SIZE);
 static struct k_thread        rx_thread_data;
 
-enum {
-	TRANSFER_INPUT_CMD,
-	TRANSFER_INPUT_ACL,
-	TRANSFER_OUTPUT_CMD,
-	TRANSFER_OUTPUT_ACL,
+/* Inbound transfer receiving straight into a host RX buffer */
+struct usb_in {
+	struct libusb_transfer *transfer;
+	struct net_buf         *buf;
+	uint8_t                 type;
+	/* No RX buffer was free, the event in buf is waiting for its pool
+	 * or the submission failed. rx_thread retries.
+	 */
+	bool                    starved;
+	/* Last submission failed, logged once until it succeeds again */
+	bool                    failed;
+};
+
+/* Outbound ACL transfer, owns the net_buf until completion */
+struct usb_out {
+	struct libusb_transfer *transfer;
+	struct net_buf         *buf;
+	/* Linearized copy of a fragmented buffer */
+	uint8_t                 bounce[BT_BUF_ACL_SIZE(CONFIG_BT_BUF_ACL_TX_SIZE)];
 };
 
 struct usb_handler {
 	struct libusb_transfer *transfer;
-	int                     address;
 	sem_t                   sem;
-	int                     type;
 };
-static struct usb_handler      g_uhandle[4];
+
+static struct usb_in           g_evt_in[CONFIG_BT_LIBUSB_EVT_IN_TRANSFERS];
+static struct usb_in           g_acl_in[CONFIG_BT_LIBUSB_ACL_IN_TRANSFERS];
+static struct usb_out          g_acl_out[CONFIG_BT_LIBUSB_ACL_OUT_TRANSFERS];
+static ATOMIC_DEFINE(g_acl_out_busy, CONFIG_BT_LIBUSB_ACL_OUT_TRANSFERS);
+static K_SEM_DEFINE(g_acl_out_sem, CONFIG_BT_LIBUSB_ACL_OUT_TRANSFERS,
+		    CONFIG_BT_LIBUSB_ACL_OUT_TRANSFERS);
+static struct usb_handler      g_cmd_out;
 static libusb_device_handle   *g_handle;
-static struct libusb_transfer *g_command_transfer;
-static struct libusb_transfer *g_acl_transfer;
+static int                     g_evt_in_address;
+static int                     g_acl_in_address;
+static int                     g_acl_out_address;
+static int                     g_starved;
+static int                     g_completed;
+/* Submitted transfers whose callback has not run yet */
+static atomic_t                g_pending;
+static bool                    g_closing;
 
-static uint8_t hci_command_input_buffer[HCI_BUFSIZE];
-static uint8_t hci_acl_input_buffer[HCI_BUFSIZE];
 static uint8_t hci_command_send_buffer[3 + 256 + LIBUSB_CONTROL_SETUP_SIZE];
 
 static void usb_data_dump(const char *tag, uint8_t *data, uint32_t len)
@@ -96,26 +115,216 @@ static void usb_data_dump(const char *tag, uint8_t *data, uint32_t len)
 #endif
 }
 
-static void usb_callback(struct libusb_transfer *transfer)
+static void usb_in_callback(struct libusb_transfer *transfer);
+
+static int usb_in_submit(struct usb_in *in)
 {
-	struct usb_handler *uhandle = transfer->user_data;
+	int ret;
+
+	if (in->buf == NULL) {
+		in->buf = bt_buf_get_rx(in->type == H4_EVT ? BT_BUF_EVT :
+					BT_BUF_ACL_IN, K_NO_WAIT);
+		if (in->buf == NULL) {
+			in->starved = true;
+			g_starved++;
+			return 0;
+		}
+	}
+
+	if (in->type == H4_EVT) {
+		libusb_fill_interrupt_transfer(in->transfer, g_handle,
+				g_evt_in_address, in->buf->data,
+				MIN(net_buf_tailroom(in->buf), HCI_BUFSIZE),
+				usb_in_callback, in, 0);
+	} else {
+		libusb_fill_bulk_transfer(in->transfer, g_handle,
+				g_acl_in_address, in->buf->data,
+				MIN(net_buf_tailroom(in->buf), HCI_BUFSIZE),
+				usb_in_callback, in, 0);
+	}
+
+	atomic_inc(&g_pending);
+
+	ret = libusb_submit_transfer(in->transfer);
+	if (ret < 0) {
+		atomic_dec(&g_pending);
+	}
+
+	return ret;
+}
+
+static void usb_in_resubmit(struct usb_in *in)
+{
+	int ret;
+
+	if (g_closing) {
+		return;
+	}
+
+	ret = usb_in_submit(in);
+	if (ret == 0) {
+		in->failed = false;
+		return;
+	}
+
+	if (!in->failed) {
+		BT_ERR("Unable to submit transfer on 0x%02x (%d)",
+		       in->transfer->endpoint, ret);
+		in->failed = true;
+	}
+
+	/* The endpoint is gone for good without a device */
+	if (ret != LIBUSB_ERROR_NO_DEVICE) {
+		in->starved = true;
+		g_starved++;
+	}
+}
+
+/* Moves an event the host serves from a dedicated pool out of the transfer
+ * buffer, false if that pool is empty and the event has to wait.
+ */
+static bool usb_evt_move(struct usb_in *in)
+{
+	struct net_buf *buf = in->buf;
+	struct net_buf *evt;
+	bool discardable;
+
+	discardable = buf->data[0] == BT_HCI_EVT_LE_META_EVENT &&
+		      buf->len > 2 &&
+		      (buf->data[2] == BT_HCI_EVT_LE_ADVERTISING_REPORT ||
+		       buf->data[2] == BT_HCI_EVT_LE_EXT_ADVERTISING_REPORT);
+
+	evt = bt_buf_get_evt(buf->data[0], discardable, K_NO_WAIT);
+	if (evt == NULL && !discardable) {
+		return false;
+	}
+
+	if (evt) {
+		if (net_buf_tailroom(evt) >= buf->len) {
+			net_buf_add_mem(evt, buf->data, buf->len);
+			bt_recv(evt);
+		} else {
+			net_buf_unref(evt);
+		}
+	}
+
+	net_buf_reset(buf);
+	net_buf_reserve(buf, BT_BUF_RESERVE);
+
+	return true;
+}
+
+static void usb_in_refill(struct usb_in *in, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count && g_starved; i++) {
+		if (!in[i].starved) {
+			continue;
+		}
+
+		if (in[i].buf && in[i].buf->len && !usb_evt_move(&in[i])) {
+			continue;
+		}
+
+		in[i].starved = false;
+		g_starved--;
+		usb_in_resubmit(&in[i]);
+	}
+}
+
+/* Returns false if the event could not be handed over yet */
+static bool usb_recv(struct usb_in *in, uint32_t len)
+{
+	struct net_buf *buf = in->buf;
+
+	net_buf_add(buf, len);
+
+	if (in->type == H4_ACL) {
+		in->buf = NULL;
+		bt_buf_set_type(buf, BT_BUF_ACL_IN);
+		bt_recv(buf);
+		return true;
+	}
+
+	if (len < sizeof(struct bt_hci_evt_hdr)) {
+		net_buf_reset(buf);
+		net_buf_reserve(buf, BT_BUF_RESERVE);
+		return true;
+	}
+
+	if (h4_rx_in_place(H4_EVT, buf->data, len)) {
+		in->buf = NULL;
+		bt_buf_set_type(buf, BT_BUF_EVT);
+		bt_recv(buf);
+		return true;
+	}
+
+	/* Event served from a dedicated pool, move it there and keep the
+	 * transfer buffer for the next one.
+	 */
+	return usb_evt_move(in);
+}
 
-	if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
-		if (transfer->endpoint == 0 ||
-				uhandle->type == TRANSFER_OUTPUT_ACL)
-			sem_post(&uhandle->sem);
-		else if (uhandle->type == TRANSFER_INPUT_CMD) {
-			if (g_command_transfer == NULL)
-				g_command_transfer = transfer;
-		} else if (uhandle->type == TRANSFER_INPUT_ACL) {
-			if (g_acl_transfer == NULL)
-				g_acl_transfer = transfer;
+static void usb_in_callback(struct libusb_transfer *transfer)
+{
+	struct usb_in *in = transfer->user_data;
+
+	g_completed++;
+	atomic_dec(&g_pending);
+
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		usb_data_dump("R", transfer->buffer, transfer->actual_length);
+		if (!usb_recv(in, transfer->actual_length)) {
+			/* Not resubmitted until rx_thread has moved the event */
+			in->starved = true;
+			g_starved++;
+			return;
 		}
-	} else if (transfer->status == LIBUSB_TRANSFER_STALL) {
+		break;
+	case LIBUSB_TRANSFER_STALL:
 		libusb_clear_halt(transfer->dev_handle, transfer->endpoint);
-		libusb_submit_transfer(transfer);
+		break;
+	case LIBUSB_TRANSFER_CANCELLED:
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		return;
+	default:
+		break;
 	}
 
+	usb_in_resubmit(in);
+}
+
+static void usb_out_callback(struct libusb_transfer *transfer)
+{
+	struct usb_out *out = transfer->user_data;
+
+	g_completed++;
+	atomic_dec(&g_pending);
+
+	if (transfer->status == LIBUSB_TRANSFER_STALL) {
+		libusb_clear_halt(transfer->dev_handle, transfer->endpoint);
+	}
+
+	net_buf_unref(out->buf);
+	out->buf = NULL;
+
+	atomic_clear_bit(g_acl_out_busy, out - g_acl_out);
+	k_sem_give(&g_acl_out_sem);
+}
+
+static void usb_cmd_callback(struct libusb_transfer *transfer)
+{
+	struct usb_handler *uhandle = transfer->user_data;
+
+	atomic_dec(&g_pending);
+
+	if (transfer->status == LIBUSB_TRANSFER_STALL) {
+		libusb_clear_halt(transfer->dev_handle, transfer->endpoint);
+	}
+
+	sem_post(&uhandle->sem);
 }
 
 static int usb_open(libusb_device_handle **handle)
@@ -284,9 +493,9 @@ static int usb_scan(libusb_device_handle *handle)
 		}
 	}
 
-	g_uhandle[TRANSFER_INPUT_CMD].address  = cmd_in_address;
-	g_uhandle[TRANSFER_INPUT_ACL].address  = acl_in_address;
-	g_uhandle[TRANSFER_OUTPUT_ACL].address = acl_out_address;
+	g_evt_in_address  = cmd_in_address;
+	g_acl_in_address  = acl_in_address;
+	g_acl_out_address = acl_out_address;
 
 	libusb_free_config_descriptor(descriptor);
 
@@ -295,118 +504,152 @@ static int usb_scan(libusb_device_handle *handle)
 
 static int usb_alloc(libusb_device_handle *handle)
 {
-	struct usb_handler *uhandle;
 	int i, ret;
 
-	for (i = 0; i < ARRAY_SIZE(g_uhandle); i++) {
-		uhandle = &g_uhandle[i];
-		uhandle->transfer = libusb_alloc_transfer(0);
-		if (uhandle->transfer == NULL)
+	g_handle = handle;
+
+	g_cmd_out.transfer = libusb_alloc_transfer(0);
+	if (g_cmd_out.transfer == NULL)
+		return -ENOMEM;
+	sem_init(&g_cmd_out.sem, 0, 1);
+
+	for (i = 0; i < ARRAY_SIZE(g_acl_out); i++) {
+		g_acl_out[i].transfer = libusb_alloc_transfer(0);
+		if (g_acl_out[i].transfer == NULL)
 			return -ENOMEM;
-		sem_init(&uhandle->sem, 0, 1);
-		uhandle->type = i;
 	}
 
-	uhandle = &g_uhandle[TRANSFER_INPUT_CMD];
+	for (i = 0; i < ARRAY_SIZE(g_evt_in); i++) {
+		g_evt_in[i].transfer = libusb_alloc_transfer(0);
+		if (g_evt_in[i].transfer == NULL)
+			return -ENOMEM;
 
-	libusb_fill_interrupt_transfer(uhandle->transfer,
-			handle, uhandle->address, hci_command_input_buffer, HCI_BUFSIZE,
-			usb_callback, uhandle, 0);
+		g_evt_in[i].type = H4_EVT;
+		ret = usb_in_submit(&g_evt_in[i]);
+		if (ret < 0)
+			return ret;
+	}
 
-	ret = libusb_submit_transfer(uhandle->transfer);
-	if (ret)
-		return ret;
+	for (i = 0; i < ARRAY_SIZE(g_acl_in); i++) {
+		g_acl_in[i].transfer = libusb_alloc_transfer(0);
+		if (g_acl_in[i].transfer == NULL)
+			return -ENOMEM;
+
+		g_acl_in[i].type = H4_ACL;
+		ret = usb_in_submit(&g_acl_in[i]);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
 
-	uhandle = &g_uhandle[TRANSFER_INPUT_ACL];
+static void usb_in_free(struct usb_in *in, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		libusb_free_transfer(in[i].transfer);
+		in[i].transfer = NULL;
+
+		if (in[i].buf) {
+			net_buf_unref(in[i].buf);
+			in[i].buf = NULL;
+		}
 
-	libusb_fill_bulk_transfer(uhandle->transfer,
-			handle, uhandle->address, hci_acl_input_buffer,
-			HCI_BUFSIZE, usb_callback, uhandle, 0) ;
+		in[i].starved = false;
+	}
+}
 
-	return libusb_submit_transfer(uhandle->transfer);
+static void usb_cancel(struct libusb_transfer *transfer)
+{
+	if (transfer) {
+		libusb_cancel_transfer(transfer);
+	}
 }
 
 static void usb_close(libusb_device_handle *handle)
 {
-	struct usb_handler *uhandle;
-	struct timeval tv = {};
-	int i;
+	struct timeval tv = { .tv_usec = 100000 };
+	int i, ret;
 
-	for (i = 0; i < ARRAY_SIZE(g_uhandle); i++) {
-		uhandle = &g_uhandle[i];
-		if (uhandle->transfer == NULL)
-			continue;
+	/* Completions no longer resubmit, cancelled ones still call back */
+	g_closing = true;
+
+	for (i = 0; i < ARRAY_SIZE(g_evt_in); i++) {
+		usb_cancel(g_evt_in[i].transfer);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(g_acl_in); i++) {
+		usb_cancel(g_acl_in[i].transfer);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(g_acl_out); i++) {
+		if (atomic_test_bit(g_acl_out_busy, i)) {
+			usb_cancel(g_acl_out[i].transfer);
+		}
+	}
 
-		if (uhandle->type == TRANSFER_INPUT_CMD ||
-				uhandle->type == TRANSFER_INPUT_ACL)
-			libusb_cancel_transfer(uhandle->transfer);
-		libusb_free_transfer(uhandle->transfer);
+	/* The command semaphore is held while a command is in flight */
+	if (sem_trywait(&g_cmd_out.sem) < 0) {
+		usb_cancel(g_cmd_out.transfer);
+	} else {
+		sem_post(&g_cmd_out.sem);
 	}
 
 	libusb_set_debug(NULL, LIBUSB_LOG_LEVEL_WARNING);
-	libusb_handle_events_timeout(NULL, &tv);
+
+	/* Transfers may only be freed once their callback has run */
+	while (atomic_get(&g_pending) > 0) {
+		ret = libusb_handle_events_timeout(NULL, &tv);
+		if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED) {
+			BT_ERR("%ld transfers left behind (%d)",
+			       atomic_get(&g_pending), ret);
+			return;
+		}
+	}
+
+	usb_in_free(g_evt_in, ARRAY_SIZE(g_evt_in));
+	usb_in_free(g_acl_in, ARRAY_SIZE(g_acl_in));
+	g_starved = 0;
+
+	for (i = 0; i < ARRAY_SIZE(g_acl_out); i++) {
+		libusb_free_transfer(g_acl_out[i].transfer);
+		g_acl_out[i].transfer = NULL;
+	}
+
+	libusb_free_transfer(g_cmd_out.transfer);
+	g_cmd_out.transfer = NULL;
+
 	libusb_release_interface(handle, 0);
 	libusb_close(handle);
+
+	g_closing = false;
 }
 
 static void rx_thread(void *p1, void *p2, void *p3)
 {
-	struct libusb_transfer *transfer;
-	struct bt_hci_evt_hdr *evt;
 	struct timeval tv = {};
-	struct net_buf *buf;
-	uint8_t *data;
-	uint32_t len;
-	uint8_t type;
 	int ret;
 
+	/* Completions are handled from the libusb callbacks */
 	for (;;) {
-		ret = libusb_handle_events_timeout(NULL, &tv);
-		if (g_command_transfer) {
-			transfer = g_command_transfer;
-			g_command_transfer = NULL;
-			type = H4_EVT;
-		} else if (g_acl_transfer) {
-			transfer = g_acl_transfer;
-			g_acl_transfer = NULL;
-			type = H4_ACL;
-		} else {
-			usleep(1);
-			continue;
-		}
-
-		data = transfer->buffer;
-		len = transfer->actual_length;
-
-		usb_data_dump("R", data, len);
+		g_completed = 0;
 
-		if (type == H4_EVT) {
-			evt = (struct bt_hci_evt_hdr *)data;
-			buf = bt_buf_get_evt(evt->evt, false, K_FOREVER);
-		} else
-			buf = bt_buf_get_rx(BT_BUF_ACL_IN, K_FOREVER);
-
-		if (buf == NULL)
+		ret = libusb_handle_events_timeout(NULL, &tv);
+		if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED)
 			break;
 
-		if (len > buf->size) {
-			net_buf_unref(buf);
-			continue;
+		if (g_starved) {
+			usb_in_refill(g_evt_in, ARRAY_SIZE(g_evt_in));
+			usb_in_refill(g_acl_in, ARRAY_SIZE(g_acl_in));
 		}
 
-		memcpy(buf->data, data, len);
-		net_buf_add(buf, len);
-
-		bt_buf_set_type(buf, type == H4_EVT ? BT_BUF_EVT : BT_BUF_ACL_IN);
-
-		bt_recv(buf);
-
-		ret = libusb_submit_transfer(transfer);
-		if (ret < 0)
-			break;
+		if (!g_completed)
+			usleep(1);
 	}
 
-	BT_ERR("INVALID BUF FORMAT\n");
+	BT_ERR("Handling USB events failed (%d)", ret);
 }
 
 static int h2_open(void)
@@ -434,8 +677,6 @@ static int h2_open(void)
 	if (ret < 0)
 		goto bail;
 
-	g_handle = handle;
-
 	k_thread_create(&rx_thread_data, rx_thread_stack,
 			K_THREAD_STACK_SIZEOF(rx_thread_stack),
 			rx_thread, NULL, NULL, NULL,
@@ -454,46 +695,100 @@ bail:
 	return ret;
 }
 
-static int h2_send(struct net_buf *buf)
+static int h2_send_cmd(struct net_buf *buf)
 {
-	uint8_t type = bt_buf_get_type(buf);
-	struct usb_handler *uhandle;
-	uint8_t *data = buf->data;
-	uint32_t len = buf->len;
 	int ret;
 
-	usb_data_dump("W", data, len);
+	if (buf->len > sizeof(hci_command_send_buffer) - LIBUSB_CONTROL_SETUP_SIZE)
+		return -EMSGSIZE;
 
-	if (type == BT_BUF_CMD) {
-		uhandle = &g_uhandle[TRANSFER_OUTPUT_CMD];
-	} else if (type == BT_BUF_ACL_OUT) {
-		uhandle = &g_uhandle[TRANSFER_OUTPUT_ACL];
-	} else
-		return -EINVAL;
-
-	sem_wait(&uhandle->sem);
+	sem_wait(&g_cmd_out.sem);
 
-	if (type == BT_BUF_CMD) {
-		libusb_fill_control_setup(hci_command_send_buffer,
-				LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE, 0, 0, 0, len);
-		memcpy(hci_command_send_buffer + LIBUSB_CONTROL_SETUP_SIZE, data, len);
+	libusb_fill_control_setup(hci_command_send_buffer,
+			LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE, 0, 0, 0, buf->len);
+	memcpy(hci_command_send_buffer + LIBUSB_CONTROL_SETUP_SIZE, buf->data, buf->len);
 
-		libusb_fill_control_transfer(uhandle->transfer, g_handle,
-				hci_command_send_buffer, usb_callback, uhandle, 0);
-		uhandle->transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+	libusb_fill_control_transfer(g_cmd_out.transfer, g_handle,
+			hci_command_send_buffer, usb_cmd_callback, &g_cmd_out, 0);
 
-	} else if (type == BT_BUF_ACL_OUT) {
-		libusb_fill_bulk_transfer(uhandle->transfer, g_handle,
-				uhandle->address, data, len, usb_callback, uhandle, 0);
-	}
+	atomic_inc(&g_pending);
 
-	ret = libusb_submit_transfer(uhandle->transfer);
-	if (ret < 0)
+	ret = libusb_submit_transfer(g_cmd_out.transfer);
+	if (ret < 0) {
+		atomic_dec(&g_pending);
+		sem_post(&g_cmd_out.sem);
 		return ret;
+	}
 
 	net_buf_unref(buf);
 
-	return ret < 0 ? ret : 0;
+	return 0;
+}
+
+static int h2_send_acl(struct net_buf *buf)
+{
+	struct usb_out *out;
+	uint8_t *data = buf->data;
+	uint32_t len = net_buf_frags_len(buf);
+	int i, ret;
+
+	k_sem_take(&g_acl_out_sem, K_FOREVER);
+
+	for (i = 0; i < ARRAY_SIZE(g_acl_out); i++) {
+		if (!atomic_test_and_set_bit(g_acl_out_busy, i))
+			break;
+	}
+
+	__ASSERT_NO_MSG(i < ARRAY_SIZE(g_acl_out));
+	out = &g_acl_out[i];
+
+	if (buf->frags) {
+		if (len > sizeof(out->bounce)) {
+			ret = -EMSGSIZE;
+			goto bail;
+		}
+
+		net_buf_linearize(out->bounce, len, buf, 0, len);
+		data = out->bounce;
+	}
+
+	/* The buffer is handed to the controller as is and only released
+	 * once the transfer completes.
+	 */
+	out->buf = buf;
+	libusb_fill_bulk_transfer(out->transfer, g_handle, g_acl_out_address,
+			data, len, usb_out_callback, out, 0);
+
+	atomic_inc(&g_pending);
+
+	ret = libusb_submit_transfer(out->transfer);
+	if (ret < 0) {
+		atomic_dec(&g_pending);
+		out->buf = NULL;
+		goto bail;
+	}
+
+	return 0;
+
+bail:
+	atomic_clear_bit(g_acl_out_busy, i);
+	k_sem_give(&g_acl_out_sem);
+
+	return ret;
+}
+
+static int h2_send(struct net_buf *buf)
+{
+	usb_data_dump("W", buf->data, buf->len);
+
+	switch (bt_buf_get_type(buf)) {
+	case BT_BUF_CMD:
+		return h2_send_cmd(buf);
+	case BT_BUF_ACL_OUT:
+		return h2_send_acl(buf);
+	default:
+		return -EINVAL;
+	}
 }
 
 static struct bt_hci_driver driver = {
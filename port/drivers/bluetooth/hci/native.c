@@ -33,6 +33,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <termios.h>
@@ -73,9 +74,10 @@ static void h4_data_dump(const char *tag, uint8_t type, uint8_t *data, uint32_t
 	lib_dumpvbuffer(tag, bufs, 2);
 }
 
-int bt_vadapter_recv(uint8_t type, uint16_t hdr, const uint8_t *data, uint16_t len)
+static struct net_buf *native_rx_alloc(uint8_t type, uint16_t hdr,
+				       uint8_t subevt)
 {
-	struct net_buf *buf = NULL;
+	struct net_buf *buf;
 
 	switch (type)
 	{
@@ -86,60 +88,92 @@ int bt_vadapter_recv(uint8_t type, uint16_t hdr, const uint8_t *data, uint16_t l
 		k_timeout_t timeout = K_FOREVER;
 
 		if (evt == BT_HCI_EVT_LE_META_EVENT &&
-		    (data[0] == BT_HCI_EVT_LE_ADVERTISING_REPORT ||
-		     data[0] == BT_HCI_EVT_LE_EXT_ADVERTISING_REPORT)) {
+		    (subevt == BT_HCI_EVT_LE_ADVERTISING_REPORT ||
+		     subevt == BT_HCI_EVT_LE_EXT_ADVERTISING_REPORT)) {
 			discardable = true;
 			timeout = K_NO_WAIT;
 		}
 
-		buf = bt_buf_get_evt(evt, discardable, timeout);
-		if (!buf) {
-			return -ENOBUFS;
-		}
-
-		net_buf_add_u8(buf, evt);
-		net_buf_add_u8(buf, len & 0xff);
-		net_buf_add_mem(buf, data, len);
+		return bt_buf_get_evt(evt, discardable, timeout);
+	}
+	case H4_ACL:
+		return bt_buf_get_rx(BT_BUF_ACL_IN, K_FOREVER);
+	default:
+		LOG_ERR("Unknown packet type: %u", type);
+		return NULL;
+	}
+}
 
+static int native_rx_deliver(struct net_buf *buf)
+{
 #ifdef CONFIG_BT_H4_DEBUG
-		if (!discardable)
-		h4_data_dump("BT RX", H4_EVT, (void *)data, len);
+	h4_data_dump("BT RX", bt_buf_get_type(buf) == BT_BUF_EVT ? H4_EVT : H4_ACL,
+		     buf->data, buf->len);
 #endif
 
 #if CONFIG_BT_THREAD_NO_PREEM
-		return bt_recv(buf);
+	return bt_recv(buf);
 #else /* !CONFIG_BT_THREAD_NO_PREEM */
-		net_buf_put(&rx_queue, buf);
-		return 0;
+	net_buf_put(&rx_queue, buf);
+	return 0;
 #endif /* CONFIG_BT_THREAD_NO_PREEM */
+}
+
+/* Borrow a host buffer for an incoming packet of len payload bytes. For
+ * events hdr is the event code and subevt the first payload byte, which
+ * is all that is needed to tell discardable reports apart; for ACL hdr
+ * is the handle and flags field. The HCI header is filled in here and
+ * *data points at where the controller writes the payload, after which
+ * the buffer goes back through bt_vadapter_rx_submit(), or is dropped
+ * with net_buf_unref().
+ */
+struct net_buf *bt_vadapter_rx_get(uint8_t type, uint16_t hdr, uint8_t subevt,
+				   uint16_t len, uint8_t **data)
+{
+	struct net_buf *buf;
+
+	buf = native_rx_alloc(type, hdr, subevt);
+	if (!buf) {
+		return NULL;
 	}
-	case H4_ACL:
-	{
-		buf = bt_buf_get_rx(BT_BUF_ACL_IN, K_FOREVER);
-		if (!buf) {
-			return -ENOBUFS;
-		}
 
+	if (type == H4_EVT) {
+		net_buf_add_u8(buf, hdr & 0xff);
+		net_buf_add_u8(buf, len & 0xff);
+	} else {
 		net_buf_add_le16(buf, hdr);
 		net_buf_add_le16(buf, len);
-		net_buf_add_mem(buf, data, len);
-
-#ifdef CONFIG_BT_H4_DEBUG
-		h4_data_dump("BT RX", H4_ACL, (void *)data, len);
-#endif
+	}
 
-#if CONFIG_BT_THREAD_NO_PREEM
-		return bt_recv(buf);
-#else /* !CONFIG_BT_THREAD_NO_PREEM */
-		net_buf_put(&rx_queue, buf);
-		return 0;
-#endif /* CONFIG_BT_THREAD_NO_PREEM */
+	if (len > net_buf_tailroom(buf)) {
+		LOG_ERR("Packet too long: %u > %zu", len, net_buf_tailroom(buf));
+		net_buf_unref(buf);
+		return NULL;
 	}
-	default:
-		LOG_ERR("Unknown packet type: %u", buf[0]);
+
+	*data = net_buf_add(buf, len);
+
+	return buf;
+}
+
+int bt_vadapter_rx_submit(struct net_buf *buf)
+{
+	return native_rx_deliver(buf);
+}
+
+int bt_vadapter_recv(uint8_t type, uint16_t hdr, const uint8_t *data, uint16_t len)
+{
+	struct net_buf *buf;
+	uint8_t *payload;
+
+	buf = bt_vadapter_rx_get(type, hdr, len ? data[0] : 0, len, &payload);
+	if (!buf) {
+		return -ENOBUFS;
 	}
 
-	return 0;
+	memcpy(payload, data, len);
+
+	return native_rx_deliver(buf);
 }
 
 static int native_send(struct net_buf *buf)
@@ -165,6 +199,20 @@ static int native_send(struct net_buf *buf)
 		return -EINVAL;
 	}
 
+	/* Fragment views are flattened into the head buffer, which always
+	 * has room for a whole ACL fragment. On failure the buffer stays
+	 * with the caller, as for any other send error.
+	 */
+	while (buf->frags) {
+		if (buf->frags->len > net_buf_tailroom(buf)) {
+			LOG_ERR("No room for fragment (len %u)", buf->frags->len);
+			return -ENOBUFS;
+		}
+
+		net_buf_add_mem(buf, buf->frags->data, buf->frags->len);
+		net_buf_frag_del(buf, buf->frags);
+	}
+
 #ifdef CONFIG_BT_H4_DEBUG
 	h4_data_dump("BT TX", type, buf->data, buf->len);
 #endif
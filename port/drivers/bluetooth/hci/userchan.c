@@ -39,25 +39,134 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/uio.h>
+#include <time.h>
 
 #include "bluetooth/bluetooth.h"
 #include "drivers/bluetooth/hci_driver.h"
 #include "../arch/sim/src/sim/up_hcisocket_host.h"
 
 #include <logging/log.h>
+#include <sys/byteorder.h>
 
-#define H4_NONE 0x00
-#define H4_CMD  0x01
-#define H4_ACL  0x02
-#define H4_SCO  0x03
-#define H4_EVT  0x04
-#define H4_ISO  0x05
+#include "h4_common.h"
+
+#define UC_TX_FRAME_SIZE (1 + MAX(BT_BUF_CMD_TX_SIZE, \
+				  BT_BUF_ACL_SIZE(CONFIG_BT_BUF_ACL_TX_SIZE)))
+
+#define UC_RX_FRAME_SIZE 512
+
+/* Received frames are read with their H:4 indicator into the reserve */
+BUILD_ASSERT(BT_BUF_RESERVE >= 1);
 
 static K_THREAD_STACK_DEFINE(rx_thread_stack, CONFIG_BT_RX_STACK_SIZE);
 static struct k_thread        rx_thread_data;
 
+/* Given on every send so the RX thread polls for the response right away */
+static K_SEM_DEFINE(rx_kick, 0, 1);
+
+/* Spare RX buffer the next frame is read into */
+static struct net_buf *rx_spare;
+
 static int uc_fd = -1;
 
+#if defined(CONFIG_BT_USERCHAN_LATENCY_STATS)
+#define UC_LAT_PENDING 4
+#define UC_LAT_BUCKETS 12
+
+static struct {
+	struct {
+		uint16_t opcode;
+		uint32_t start;
+	} pending[UC_LAT_PENDING];
+	/* Bucket i counts round trips below (64 << i) us, the last one the rest */
+	uint32_t hist[UC_LAT_BUCKETS];
+	uint32_t count;
+	uint32_t max;
+	uint32_t next;
+} uc_lat;
+
+static uint32_t uc_lat_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * USEC_PER_SEC + ts.tv_nsec / NSEC_PER_USEC;
+}
+
+static void uc_lat_cmd_sent(const uint8_t *cmd)
+{
+	/* Oldest entry goes first, it lost its response anyway */
+	int i = uc_lat.next++ % UC_LAT_PENDING;
+
+	uc_lat.pending[i].opcode = sys_get_le16(cmd);
+	uc_lat.pending[i].start = uc_lat_now();
+}
+
+static void uc_lat_dump(void)
+{
+	int i;
+
+	LOG_INF("HCI command round trip, %u samples, max %u us",
+		uc_lat.count, uc_lat.max);
+
+	for (i = 0; i < UC_LAT_BUCKETS - 1; i++) {
+		LOG_INF("  < %6u us: %u", 64U << i, uc_lat.hist[i]);
+	}
+
+	LOG_INF(" >= %6u us: %u", 64U << (UC_LAT_BUCKETS - 2), uc_lat.hist[i]);
+}
+
+static void uc_lat_evt_recv(const uint8_t *frame, size_t len)
+{
+	uint16_t opcode;
+	uint32_t delta;
+	int i;
+
+	if (frame[1] == BT_HCI_EVT_CMD_COMPLETE && len >= 6) {
+		opcode = sys_get_le16(&frame[4]);
+	} else if (frame[1] == BT_HCI_EVT_CMD_STATUS && len >= 7) {
+		opcode = sys_get_le16(&frame[5]);
+	} else {
+		return;
+	}
+
+	/* Controller only reporting free command slots */
+	if (opcode == BT_OP_NOP) {
+		return;
+	}
+
+	for (i = 0; i < UC_LAT_PENDING; i++) {
+		if (uc_lat.pending[i].opcode == opcode) {
+			break;
+		}
+	}
+
+	if (i == UC_LAT_PENDING) {
+		return;
+	}
+
+	delta = uc_lat_now() - uc_lat.pending[i].start;
+	uc_lat.pending[i].opcode = 0;
+
+	for (i = 0; i < UC_LAT_BUCKETS - 1; i++) {
+		if (delta < (64U << i)) {
+			break;
+		}
+	}
+
+	uc_lat.hist[i]++;
+	uc_lat.max = MAX(uc_lat.max, delta);
+
+	if (!(++uc_lat.count % CONFIG_BT_USERCHAN_LATENCY_DUMP)) {
+		uc_lat_dump();
+	}
+}
+#else
+#define uc_lat_cmd_sent(cmd)
+#define uc_lat_evt_recv(frame, len)
+#endif /* CONFIG_BT_USERCHAN_LATENCY_STATS */
+
 static struct net_buf *get_rx(const uint8_t *buf)
 {
 	bool discardable = false;
@@ -66,7 +175,8 @@ static struct net_buf *get_rx(const uint8_t *buf)
 	switch (buf[0]) {
 	case H4_EVT:
 		if (buf[1] == BT_HCI_EVT_LE_META_EVENT &&
-		    (buf[3] == BT_HCI_EVT_LE_ADVERTISING_REPORT)) {
+		    (buf[3] == BT_HCI_EVT_LE_ADVERTISING_REPORT ||
+		     buf[3] == BT_HCI_EVT_LE_EXT_ADVERTISING_REPORT)) {
 			discardable = true;
 			timeout = K_NO_WAIT;
 		}
@@ -91,68 +201,153 @@ static bool uc_ready(void)
 	return bthcisock_host_avail(uc_fd);
 }
 
-static void rx_thread(void *p1, void *p2, void *p3)
+static int uc_recv(void)
 {
-	ARG_UNUSED(p1);
-	ARG_UNUSED(p2);
-	ARG_UNUSED(p3);
+	static uint8_t frame[UC_RX_FRAME_SIZE];
+	struct net_buf *buf;
+	size_t buf_tailroom;
+	size_t buf_add_len;
+	uint8_t *data;
+	ssize_t len;
+
+	if (!rx_spare) {
+		rx_spare = bt_buf_get_rx(BT_BUF_EVT, K_NO_WAIT);
+	}
 
-	LOG_DBG("started");
+	LOG_DBG("calling read()");
 
-	while (1) {
-		static uint8_t frame[512];
-		struct net_buf *buf;
-		size_t buf_tailroom;
-		size_t buf_add_len;
-		ssize_t len;
+	if (rx_spare) {
+		data = rx_spare->data - 1;
+		len = bthcisock_host_read(uc_fd, data,
+					  net_buf_tailroom(rx_spare) + 1);
+	} else {
+		data = frame;
+		len = bthcisock_host_read(uc_fd, data, sizeof(frame));
+	}
 
-		if (!uc_ready()) {
-			k_sleep(K_MSEC(1));
-			continue;
-		}
+	if (len < 0) {
+		return -errno;
+	} else if (len < 2) {
+		return 0;
+	}
 
-		LOG_DBG("calling read()");
+	if (data[0] == H4_EVT) {
+		uc_lat_evt_recv(data, len);
+	}
 
-		len = bthcisock_host_read(uc_fd, frame, sizeof(frame));
-		if (len < 0) {
-			if (errno == EINTR) {
-				k_yield();
-				continue;
-			}
+	buf_add_len = len - 1;
 
-			LOG_ERR("Reading socket failed, errno %d", errno);
-			bthcisock_host_close(uc_fd);
-			uc_fd = -1;
-			return;
-		}
+	if (data != frame && h4_rx_in_place(data[0], &data[1], buf_add_len)) {
+		buf = rx_spare;
+		rx_spare = NULL;
 
-		buf = get_rx(frame);
+		bt_buf_set_type(buf, data[0] == H4_ACL ? BT_BUF_ACL_IN :
+							 BT_BUF_EVT);
+		net_buf_add(buf, buf_add_len);
+	} else {
+		buf = get_rx(data);
 		if (!buf) {
 			LOG_DBG("Discard adv report due to insufficient buf");
-			continue;
+			return 0;
 		}
 
 		buf_tailroom = net_buf_tailroom(buf);
-		buf_add_len = len - 1;
 		if (buf_tailroom < buf_add_len) {
 			LOG_ERR("Not enough space in buffer %zu/%zu",
 			       buf_add_len, buf_tailroom);
 			net_buf_unref(buf);
-			continue;
+			return 0;
 		}
 
-		net_buf_add_mem(buf, &frame[1], buf_add_len);
+		net_buf_add_mem(buf, &data[1], buf_add_len);
+	}
 
-		LOG_DBG("Calling bt_recv(%p)", buf);
+	LOG_DBG("Calling bt_recv(%p)", buf);
 
-		bt_recv(buf);
+	bt_recv(buf);
+
+	return 0;
+}
+
+static void rx_thread(void *p1, void *p2, void *p3)
+{
+	int spin = 0;
+	int err;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	LOG_DBG("started");
+
+	/* The host socket cannot wake us up, so poll it: back to back while
+	 * traffic is flowing or a response is due, and at the idle interval
+	 * otherwise. A send cuts the idle wait short.
+	 */
+	while (1) {
+		if (!uc_ready()) {
+			if (spin) {
+				spin--;
+				k_yield();
+			} else if (!k_sem_take(&rx_kick,
+					K_USEC(CONFIG_BT_USERCHAN_RX_POLL_US))) {
+				spin = CONFIG_BT_USERCHAN_RX_SPIN;
+			}
+
+			continue;
+		}
+
+		err = uc_recv();
+		if (err == -EINTR) {
+			k_yield();
+			continue;
+		} else if (err < 0) {
+			LOG_ERR("Reading socket failed, errno %d", -err);
+			bthcisock_host_close(uc_fd);
+			uc_fd = -1;
+			return;
+		}
+
+		spin = CONFIG_BT_USERCHAN_RX_SPIN;
 
 		k_yield();
 	}
 }
 
+static ssize_t uc_writev(void *ctx, const struct iovec *iov, int iovcnt)
+{
+	static uint8_t frame[UC_TX_FRAME_SIZE];
+	size_t len = 0;
+	ssize_t ret;
+	int i;
+
+	if (iovcnt == 1) {
+		ret = bthcisock_host_send(uc_fd, iov->iov_base, iov->iov_len);
+		return ret < 0 ? -errno : ret;
+	}
+
+	/* The HCI socket takes whole packets only, gather the fragments
+	 * so the packet still goes out in a single send.
+	 */
+	for (i = 0; i < iovcnt; i++) {
+		if (len + iov[i].iov_len > sizeof(frame)) {
+			return -EMSGSIZE;
+		}
+
+		memcpy(frame + len, iov[i].iov_base, iov[i].iov_len);
+		len += iov[i].iov_len;
+	}
+
+	ret = bthcisock_host_send(uc_fd, frame, len);
+
+	return ret < 0 ? -errno : ret;
+}
+
 static int uc_send(struct net_buf *buf)
 {
+	uint8_t type;
+	int err;
+
 	LOG_DBG("buf %p type %u len %u", buf, bt_buf_get_type(buf), buf->len);
 
 	if (uc_fd < 0) {
@@ -162,14 +357,14 @@ static int uc_send(struct net_buf *buf)
 
 	switch (bt_buf_get_type(buf)) {
 	case BT_BUF_ACL_OUT:
-		net_buf_push_u8(buf, H4_ACL);
+		type = H4_ACL;
 		break;
 	case BT_BUF_CMD:
-		net_buf_push_u8(buf, H4_CMD);
+		type = H4_CMD;
 		break;
 	case BT_BUF_ISO_OUT:
 		if (IS_ENABLED(CONFIG_BT_ISO)) {
-			net_buf_push_u8(buf, H4_ISO);
+			type = H4_ISO;
 			break;
 		}
 		__fallthrough;
@@ -178,10 +373,17 @@ static int uc_send(struct net_buf *buf)
 		return -EINVAL;
 	}
 
-	if (bthcisock_host_send(uc_fd, buf->data, buf->len) < 0) {
-		return -errno;
+	if (type == H4_CMD) {
+		uc_lat_cmd_sent(buf->data);
 	}
 
+	err = h4_tx_send(buf, type, uc_writev, NULL);
+	if (err < 0) {
+		return err;
+	}
+
+	k_sem_give(&rx_kick);
+
 	net_buf_unref(buf);
 	return 0;
 }
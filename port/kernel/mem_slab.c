@@ -34,18 +34,127 @@
 
 #include <stdlib.h>
 
+#include <arch/irq.h>
+
 #include <device.h>
 #include <kernel.h>
 #include <sys/check.h>
 #include <kernel_structs.h>
 #include <ksched.h>
 
-static struct k_spinlock lock;
+/* The free list is a Treiber stack of block indexes. free_head keeps the
+ * index of the top block in its low half and an ABA tag, bumped on every
+ * pop, in its high half. Each free block stores the index of the next one
+ * in its first word.
+ */
+#define SLAB_IDX_BITS	(sizeof(atomic_t) * 4)
+#define SLAB_IDX_NONE	((unsigned long)-1 >> SLAB_IDX_BITS)
+#define SLAB_TAG_ONE	(SLAB_IDX_NONE + 1)
+
+struct slab_waiter {
+	sys_dnode_t node;
+	struct k_sem wait;
+	void *mem;
+};
 
 #ifdef CONFIG_OBJECT_TRACING
 struct k_mem_slab *_trace_list_k_mem_slab;
 #endif	/* CONFIG_OBJECT_TRACING */
 
+/* Only the blocking slow path takes the slab lock. It masks local
+ * interrupts and, on SMP, spins on this slab alone rather than on the
+ * global critical section behind k_spin_lock().
+ */
+static inline irqstate_t slab_lock(struct k_mem_slab *slab)
+{
+	irqstate_t flags = up_irq_save();
+
+#ifdef CONFIG_SMP
+	while (__atomic_exchange_n(&slab->lock.locked, 1, __ATOMIC_ACQUIRE)) {
+	}
+#endif
+
+	return flags;
+}
+
+static inline void slab_unlock(struct k_mem_slab *slab, irqstate_t flags)
+{
+#ifdef CONFIG_SMP
+	__atomic_store_n(&slab->lock.locked, 0, __ATOMIC_RELEASE);
+#endif
+
+	up_irq_restore(flags);
+}
+
+static inline char *slab_block(struct k_mem_slab *slab, unsigned long idx)
+{
+	return slab->buffer + idx * slab->block_size;
+}
+
+static void *slab_pop(struct k_mem_slab *slab)
+{
+	unsigned long old, new, idx;
+	char *block;
+
+	old = __atomic_load_n(&slab->free_head, __ATOMIC_ACQUIRE);
+
+	do {
+		idx = old & SLAB_IDX_NONE;
+		if (idx == SLAB_IDX_NONE) {
+			return NULL;
+		}
+
+		/* May read a block another thread has just taken; the tag
+		 * makes the exchange below fail in that case.
+		 */
+		block = slab_block(slab, idx);
+		new = (*(unsigned long *)block & SLAB_IDX_NONE) |
+		      ((old + SLAB_TAG_ONE) & ~SLAB_IDX_NONE);
+	} while (!__atomic_compare_exchange_n(&slab->free_head, &old, new,
+					      true, __ATOMIC_ACQ_REL,
+					      __ATOMIC_ACQUIRE));
+
+	return block;
+}
+
+static void slab_push(struct k_mem_slab *slab, void *mem)
+{
+	unsigned long idx = ((char *)mem - slab->buffer) / slab->block_size;
+	unsigned long old, new;
+
+	old = __atomic_load_n(&slab->free_head, __ATOMIC_RELAXED);
+
+	do {
+		*(unsigned long *)mem = old & SLAB_IDX_NONE;
+		new = idx | (old & ~SLAB_IDX_NONE);
+	} while (!__atomic_compare_exchange_n(&slab->free_head, &old, new,
+					      true, __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+}
+
+static void slab_account_alloc(struct k_mem_slab *slab)
+{
+#ifdef CONFIG_MEM_SLAB_TRACE_MAX_UTILIZATION
+	uint32_t used = __atomic_add_fetch(&slab->num_used, 1, __ATOMIC_RELAXED);
+	uint32_t max = __atomic_load_n(&slab->max_used, __ATOMIC_RELAXED);
+
+	while (used > max &&
+	       !__atomic_compare_exchange_n(&slab->max_used, &max, used, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+#else
+	__atomic_add_fetch(&slab->num_used, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+static int slab_alloc_failed(struct k_mem_slab *slab, void **mem, int result)
+{
+	__atomic_add_fetch(&slab->num_failed, 1, __ATOMIC_RELAXED);
+	*mem = NULL;
+
+	return result;
+}
+
 /**
  * @brief Initialize kernel memory slab subsystem.
  *
@@ -56,8 +165,7 @@ struct k_mem_slab *_trace_list_k_mem_slab;
  */
 static int create_free_list(struct k_mem_slab *slab)
 {
-	uint32_t j;
-	char *p;
+	unsigned long j;
 
 	/* blocks must be word aligned */
 	CHECKIF(((slab->block_size | (uintptr_t)slab->buffer) &
@@ -65,15 +173,18 @@ static int create_free_list(struct k_mem_slab *slab)
 		return -EINVAL;
 	}
 
-	slab->free_list = NULL;
-	p = slab->buffer;
+	/* block indexes must fit below the ABA tag */
+	CHECKIF(slab->num_blocks >= SLAB_IDX_NONE) {
+		return -EINVAL;
+	}
 
 	for (j = 0U; j < slab->num_blocks; j++) {
-		*(char **)p = slab->free_list;
-		slab->free_list = p;
-		p += slab->block_size;
+		*(unsigned long *)slab_block(slab, j) =
+			j + 1 < slab->num_blocks ? j + 1 : SLAB_IDX_NONE;
 	}
 
+	slab->free_head = slab->num_blocks ? 0 : SLAB_IDX_NONE;
+
 	return 0;
 }
 
@@ -107,50 +218,114 @@ SYS_INIT(init_mem_slab_module, PRE_KERNEL_1,
 int k_mem_slab_alloc(struct k_mem_slab *slab,
 		     void **mem, k_timeout_t timeout)
 {
-	k_spinlock_key_t key = k_spin_lock(&lock);
+	struct slab_waiter waiter = {
+		.node = SYS_DLIST_STATIC_INIT(NULL),
+		.wait = Z_SEM_INITIALIZER(waiter.wait, 0, 1),
+		.mem = NULL,
+	};
+	irqstate_t flags;
 	int result;
 
-	if (slab->free_list != NULL) {
-		/* take a free block */
-		*mem = slab->free_list;
-		slab->free_list = *(char **)(slab->free_list);
-		slab->num_used++;
-		result = 0;
-	} else if (K_TIMEOUT_EQ(timeout, K_NO_WAIT)) {
+	*mem = slab_pop(slab);
+	if (*mem != NULL) {
+		slab_account_alloc(slab);
+		return 0;
+	}
+
+	if (K_TIMEOUT_EQ(timeout, K_NO_WAIT)) {
 		/* don't wait for a free block to become available */
-		*mem = NULL;
-		result = -ENOMEM;
-	} else {
-		result = z_sched_wait(&lock, key, &slab->wait_q, timeout, NULL);
-		if (result) {
-			return result;
-		}
+		return slab_alloc_failed(slab, mem, -ENOMEM);
+	}
 
-		__ASSERT_NO_MSG(slab->free_list != NULL);
+	flags = slab_lock(slab);
 
-		key = k_spin_lock(&lock);
+	/* Announce the waiter before the last look at the free list, so a
+	 * concurrent k_mem_slab_free() either leaves its block for us to pop
+	 * here or sees the waiter and hands the block over.
+	 */
+	__atomic_add_fetch(&slab->waiters, 1, __ATOMIC_SEQ_CST);
 
-		*mem = slab->free_list;
-		slab->free_list = *(char **)(slab->free_list);
-		slab->num_used++;
+	/* Pairs with the fence in k_mem_slab_free(): release/acquire alone
+	 * would let both sides miss each other's store.
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
 
-		k_spin_unlock(&lock, key);
+	*mem = slab_pop(slab);
+	if (*mem != NULL) {
+		__atomic_sub_fetch(&slab->waiters, 1, __ATOMIC_RELAXED);
+		slab_unlock(slab, flags);
+		slab_account_alloc(slab);
+		return 0;
 	}
 
-	k_spin_unlock(&lock, key);
+	sys_dlist_append(&slab->wait_q.waitq, &waiter.node);
 
-	return result;
+	slab_unlock(slab, flags);
+
+	result = k_sem_take(&waiter.wait, timeout);
+
+	if (result) {
+		/* The free path may have handed us a block after the timeout
+		 * fired; keep it rather than leak it.
+		 */
+		flags = slab_lock(slab);
+
+		if (waiter.mem == NULL) {
+			sys_dlist_remove(&waiter.node);
+			__atomic_sub_fetch(&slab->waiters, 1, __ATOMIC_RELAXED);
+		}
+
+		slab_unlock(slab, flags);
+	}
+
+	*mem = waiter.mem;
+	if (*mem == NULL) {
+		return slab_alloc_failed(slab, mem, result);
+	}
+
+	slab_account_alloc(slab);
+
+	return 0;
 }
 
 void k_mem_slab_free(struct k_mem_slab *slab, void **mem)
 {
-	k_spinlock_key_t key = k_spin_lock(&lock);
+	struct slab_waiter *waiter;
+	sys_dnode_t *node;
+	irqstate_t flags;
+
+	__atomic_sub_fetch(&slab->num_used, 1, __ATOMIC_RELAXED);
+
+	slab_push(slab, *mem);
 
-	**(char ***)mem = slab->free_list;
-	slab->free_list = *(char **)mem;
-	slab->num_used--;
+	/* Order the push before reading waiters, see k_mem_slab_alloc() */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
 
-	(void)z_sched_wake(&slab->wait_q, 0, NULL);
+	if (!__atomic_load_n(&slab->waiters, __ATOMIC_SEQ_CST)) {
+		return;
+	}
+
+	/* Waking a waiter may switch to it, which must not happen while
+	 * this CPU holds the slab lock.
+	 */
+	k_sched_lock();
+	flags = slab_lock(slab);
+
+	while (!sys_dlist_is_empty(&slab->wait_q.waitq)) {
+		void *block = slab_pop(slab);
+
+		if (block == NULL) {
+			break;
+		}
+
+		node = sys_dlist_get(&slab->wait_q.waitq);
+		waiter = CONTAINER_OF(node, struct slab_waiter, node);
+		__atomic_sub_fetch(&slab->waiters, 1, __ATOMIC_RELAXED);
+
+		waiter->mem = block;
+		k_sem_give(&waiter->wait);
+	}
 
-	k_spin_unlock(&lock, key);
+	slab_unlock(slab, flags);
+	k_sched_unlock();
 }
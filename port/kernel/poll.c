@@ -34,6 +34,23 @@
 
 #include <kernel.h>
 #include <kernel_structs.h>
+#include <spinlock.h>
+
+/* Handlers wake pollers with the lock held, so this stays on the
+ * k_spin_lock() mapping even when irq_lock() is a plain spinlock.
+ */
+static struct k_spinlock lock;
+
+/* A k_poll() call on the stack of the polling thread. Every event it
+ * registers points at the embedded z_poller, and an object handler marks
+ * each event it fires directly, so the caller never has to re-scan the
+ * event array to learn what woke it.
+ */
+struct poll_waiter {
+	struct z_poller poller;
+	struct k_sem wait;
+	int ready;
+};
 
 void k_poll_event_init(struct k_poll_event *event, uint32_t type, int mode, void *obj)
 {
@@ -58,35 +75,66 @@ static bool event_match(struct k_poll_event *event, uint32_t state)
 	}
 }
 
-void z_handle_obj_poll_events(sys_dlist_t *events, uint32_t state)
+/* Wake every poller registered on the object that waits for this state.
+ * Fired events are unlinked here, so each costs O(1) and a later signal
+ * does not see it again.
+ */
+static int handle_poll_events_locked(sys_dlist_t *events, uint32_t state)
 {
-	struct k_poll_event *event;
-	unsigned int key;
+	struct k_poll_event *event, *next;
+	struct poll_waiter *waiter;
+	int woken = 0;
+
+	SYS_DLIST_FOR_EACH_CONTAINER_SAFE(events, event, next, _node) {
+		if (state != K_POLL_STATE_CANCELLED &&
+		    !event_match(event, state)) {
+			continue;
+		}
 
-	key = irq_lock();
+		sys_dlist_remove(&event->_node);
+		event->state |= state;
 
-	event = (struct k_poll_event *)sys_dlist_get(events);
-	if (!event || !event->poller) {
-		irq_unlock(key);
-		return;
-	}
+		waiter = CONTAINER_OF(event->poller, struct poll_waiter, poller);
+		if (waiter->ready++ == 0) {
+			k_sem_give(&waiter->wait);
+		}
 
-	if (state == K_POLL_STATE_CANCELLED ||
-	    event_match(event, state)) {
-		k_sem_give((struct k_sem *)event->poller);
+		woken++;
 	}
 
-	irq_unlock(key);
+	return woken;
+}
+
+void z_handle_obj_poll_events(sys_dlist_t *events, uint32_t state)
+{
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&lock);
+	(void)handle_poll_events_locked(events, state);
+	k_spin_unlock(&lock, key);
 }
 
 int k_poll_signal_raise(struct k_poll_signal *signal, int result)
 {
-	signal->signaled = 1;
-	z_handle_obj_poll_events(&signal->poll_events, K_POLL_STATE_SIGNALED);
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&lock);
+
+	signal->result = result;
+
+	/* A signal delivered to a poller is consumed, as one found raised
+	 * by k_poll() is.
+	 */
+	signal->signaled = !handle_poll_events_locked(&signal->poll_events,
+						      K_POLL_STATE_SIGNALED);
+
+	k_spin_unlock(&lock, key);
+
 	return 0;
 }
 
-static void poll_event_add(struct k_poll_event *event)
+static void poll_event_add(struct k_poll_event *event,
+			   struct poll_waiter *waiter)
 {
 	sys_dnode_t *events;
 
@@ -99,6 +147,7 @@ static void poll_event_add(struct k_poll_event *event)
 	else
 		return;
 
+	event->poller = &waiter->poller;
 	sys_dlist_append(events, &event->_node);
 }
 
@@ -107,13 +156,15 @@ static void poll_event_remove(struct k_poll_event *event)
 	if (sys_dnode_is_linked(&event->_node)) {
 		sys_dlist_remove(&event->_node);
 	}
+
+	event->poller = NULL;
 }
 
 static int k_poll_event_ready(struct k_poll_event *event)
 {
 	switch (event->type) {
 		case K_POLL_TYPE_DATA_AVAILABLE:
-			if (!sys_sflist_is_empty(&event->queue->data_q)) {
+			if (!k_queue_is_empty(event->queue)) {
 				event->state = K_POLL_STATE_DATA_AVAILABLE;
 				return true;
 			}
@@ -137,53 +188,54 @@ static int k_poll_event_ready(struct k_poll_event *event)
 	return false;
 }
 
-static bool poll_event_pending(struct k_poll_event *events, int num_events)
+int k_poll(struct k_poll_event *events, int num_events, k_timeout_t timeout)
 {
-	int i;
+	struct poll_waiter waiter = {
+		.wait = Z_SEM_INITIALIZER(waiter.wait, 0, 1),
+	};
+	int i, num_added = 0, err = 0;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&lock);
 
+	/* Check and register in one pass. Once an event is found ready the
+	 * call will not block, so the remaining events are only checked.
+	 */
 	for (i = 0; i < num_events; i++) {
 		if (k_poll_event_ready(&events[i])) {
-			return true;
+			waiter.ready++;
+		} else if (!waiter.ready && !K_TIMEOUT_EQ(timeout, K_NO_WAIT)) {
+			poll_event_add(&events[i], &waiter);
+			num_added = i + 1;
 		}
 	}
 
-	return false;
-}
-
-int k_poll(struct k_poll_event *events, int num_events, k_timeout_t timeout)
-{
-	struct k_sem poller;
-	int key, i, err = 0;
-
-	key = irq_lock();
-
-	if (poll_event_pending(events, num_events) ||
-	    K_TIMEOUT_EQ(timeout, K_NO_WAIT)) {
+	if (waiter.ready || K_TIMEOUT_EQ(timeout, K_NO_WAIT)) {
+		err = waiter.ready ? 0 : -EAGAIN;
 		goto end;
 	}
 
-	k_sem_init(&poller, 0, 1);
+	k_spin_unlock(&lock, key);
 
-	for (i = 0; i < num_events; i++) {
-		poll_event_add(&events[i]);
-		events[i].poller = (void *)&poller;
-	}
+	(void)k_sem_take(&waiter.wait, timeout);
 
-	irq_unlock(key);
+	key = k_spin_lock(&lock);
 
-	err = k_sem_take(&poller, timeout);
-
-	key = irq_lock();
+	if (!waiter.ready) {
+		err = -EAGAIN;
+	}
 
-	poll_event_pending(events, num_events);
+end:
+	/* Fired events were already unlinked and marked by the handler. */
+	for (i = 0; i < num_added; i++) {
+		if (events[i].state == K_POLL_STATE_CANCELLED) {
+			err = -EINTR;
+		}
 
-	for (i = 0; i < num_events; i++) {
 		poll_event_remove(&events[i]);
-		events[i].poller = NULL;
 	}
 
-end:
-	irq_unlock(key);
+	k_spin_unlock(&lock, key);
 
 	return err;
 }
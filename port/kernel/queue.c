@@ -42,6 +42,76 @@ static void handle_poll_events(struct k_queue *queue, uint32_t state)
 	z_handle_obj_poll_events(&queue->poll_events, state);
 }
 
+/* Pollers only wait on a queue found empty under the lock, so they are
+ * woken when data_q goes from empty to non-empty, by whoever does it:
+ *
+ * - a locked append, prepend or insert that finds data_q empty;
+ * - a getter that drains the inbox into an empty data_q and leaves items
+ *   behind for others;
+ * - a lock-free append that finds both the inbox and data_q empty.
+ *
+ * The last one reads data_q without the lock, after publishing its node.
+ * If it sees data_q non-empty, one of the locked cases above has woken or
+ * will wake the pollers.
+ */
+
+/* Invoked with the queue lock held, which also keeps a concurrent drain
+ * from hiding items between the inbox and data_q.
+ */
+static inline bool queue_is_empty(struct k_queue *queue)
+{
+	return sys_sflist_is_empty(&queue->data_q) &&
+	       __atomic_load_n(&queue->inbox, __ATOMIC_ACQUIRE) == NULL;
+}
+
+/* Move everything appended lock-free onto the tail of data_q, oldest
+ * first. Invoked with the queue lock held.
+ */
+static void queue_drain_locked(struct k_queue *queue)
+{
+	sys_sfnode_t *node, *next, *prev = NULL, *tail;
+
+	node = __atomic_exchange_n(&queue->inbox, NULL, __ATOMIC_ACQUIRE);
+	if (node == NULL) {
+		return;
+	}
+
+	tail = node;
+
+	while (node != NULL) {
+		next = (sys_sfnode_t *)node->next_and_flags;
+		node->next_and_flags = (unative_t)prev;
+		prev = node;
+		node = next;
+	}
+
+	sys_sflist_append_list(&queue->data_q, prev, tail);
+}
+
+static void *queue_get(struct k_queue *queue)
+{
+	k_spinlock_key_t key;
+	bool wake = false;
+	void *data;
+
+	key = k_spin_lock(&queue->lock);
+
+	if (sys_sflist_is_empty(&queue->data_q)) {
+		queue_drain_locked(queue);
+		wake = true;
+	}
+
+	data = sys_sflist_get(&queue->data_q);
+	wake = wake && !sys_sflist_is_empty(&queue->data_q);
+
+	k_spin_unlock(&queue->lock, key);
+
+	if (wake)
+		handle_poll_events(queue, K_POLL_STATE_DATA_AVAILABLE);
+
+	return data;
+}
+
 void k_queue_cancel_wait(struct k_queue *queue)
 {
 	handle_poll_events(queue, K_POLL_STATE_CANCELLED);
@@ -51,6 +121,7 @@ void k_queue_init(struct k_queue *queue)
 {
 	k_spinlock_key_t key = k_spin_lock(&queue->lock);
 	sys_sflist_init(&queue->data_q);
+	queue->inbox = NULL;
 	sys_dlist_init(&queue->poll_events);
 	k_spin_unlock(&queue->lock, key);
 }
@@ -58,87 +129,149 @@ void k_queue_init(struct k_queue *queue)
 void k_queue_insert(struct k_queue *queue, void *prev, void *data)
 {
 	k_spinlock_key_t key = k_spin_lock(&queue->lock);
+	bool was_empty;
+
+	was_empty = sys_sflist_is_empty(&queue->data_q);
+	queue_drain_locked(queue);
 	sys_sflist_insert(&queue->data_q, prev, data);
 	k_spin_unlock(&queue->lock, key);
 
-	handle_poll_events(queue, K_POLL_STATE_DATA_AVAILABLE);
+	if (was_empty)
+		handle_poll_events(queue, K_POLL_STATE_DATA_AVAILABLE);
 }
 
 void k_queue_append(struct k_queue *queue, void *data)
 {
 	k_spinlock_key_t key;
+	bool was_empty;
 
+	/* Drain first so the item stays behind anything appended lock-free
+	 * before it.
+	 */
 	key = k_spin_lock(&queue->lock);
+	was_empty = sys_sflist_is_empty(&queue->data_q);
+	queue_drain_locked(queue);
 	sys_sflist_append(&queue->data_q, data);
 	k_spin_unlock(&queue->lock, key);
 
-	handle_poll_events(queue, K_POLL_STATE_DATA_AVAILABLE);
+	if (was_empty)
+		handle_poll_events(queue, K_POLL_STATE_DATA_AVAILABLE);
 }
 
 void k_queue_prepend(struct k_queue *queue, void *data)
 {
 	k_spinlock_key_t key;
+	bool was_empty;
 
 	key = k_spin_lock(&queue->lock);
+	was_empty = sys_sflist_is_empty(&queue->data_q);
 	sys_sflist_prepend(&queue->data_q, data);
 	k_spin_unlock(&queue->lock, key);
 
-	handle_poll_events(queue, K_POLL_STATE_DATA_AVAILABLE);
+	if (was_empty)
+		handle_poll_events(queue, K_POLL_STATE_DATA_AVAILABLE);
 }
 
 static void *k_queue_poll(struct k_queue *queue, k_timeout_t timeout)
 {
+	uint64_t end = sys_clock_timeout_end_calc(timeout);
 	struct k_poll_event event;
-	k_spinlock_key_t key;
 	void *data = NULL;
+	int64_t remaining;
 	int err;
 
-	k_poll_event_init(&event, K_POLL_TYPE_DATA_AVAILABLE,
-			  K_POLL_MODE_NOTIFY_ONLY, queue);
+	/* k_poll() wakes every getter waiting on the queue, so another one
+	 * may have taken the item first; keep waiting out the timeout.
+	 */
+	for (;;) {
+		k_poll_event_init(&event, K_POLL_TYPE_DATA_AVAILABLE,
+				  K_POLL_MODE_NOTIFY_ONLY, queue);
 
-	event.state = K_POLL_STATE_NOT_READY;
-	err = k_poll(&event, 1, timeout);
-	if (err)
-		return NULL;
+		event.state = K_POLL_STATE_NOT_READY;
+		err = k_poll(&event, 1, timeout);
+		if (err)
+			return NULL;
 
-	key = k_spin_lock(&queue->lock);
-	data = sys_sflist_get(&queue->data_q);
-	k_spin_unlock(&queue->lock, key);
+		data = queue_get(queue);
 
-	return data;
+		if (data != NULL)
+			return data;
+
+		if (K_TIMEOUT_EQ(timeout, K_FOREVER))
+			continue;
+
+		remaining = end - sys_clock_tick_get();
+		if (remaining <= 0)
+			return NULL;
+
+		timeout = K_TICKS(remaining);
+	}
 }
 
 void *k_queue_get(struct k_queue *queue, k_timeout_t timeout)
 {
-	k_spinlock_key_t key;
 	void *data;
 
-	if (sys_sflist_is_empty(&queue->data_q)) {
-		if (K_TIMEOUT_EQ(timeout, K_NO_WAIT))
-			return NULL;
-	} else {
-		key = k_spin_lock(&queue->lock);
-		data = sys_sflist_get(&queue->data_q);
-		k_spin_unlock(&queue->lock, key);
+	data = queue_get(queue);
+	if (data != NULL || K_TIMEOUT_EQ(timeout, K_NO_WAIT))
 		return data;
-	}
 
 	return k_queue_poll(queue, timeout);
 }
 
+/* Lock-free for any number of producers: the list is reversed onto the
+ * inbox with one compare-and-swap and the consumer restores the order
+ * when it drains. net_buf_put() lands here, so moving a buffer between
+ * the driver, bt_dev.rx_queue and the connection TX queues takes neither
+ * the queue lock nor, unless the whole queue was empty, the poll lock.
+ */
 int k_queue_append_list(struct k_queue *queue, void *head, void *tail)
 {
-	k_spinlock_key_t key;
+	sys_sfnode_t *node, *next, *prev, *old;
 
-	key = k_spin_lock(&queue->lock);
-	sys_sflist_append_list(&queue->data_q, head, tail);
-	k_spin_unlock(&queue->lock, key);
+	if (head == NULL || tail == NULL)
+		return -EINVAL;
+
+	/* Reverse head..tail so that tail comes first, like the inbox. */
+	prev = NULL;
+	node = head;
+
+	for (;;) {
+		next = (sys_sfnode_t *)node->next_and_flags;
+		node->next_and_flags = (unative_t)prev;
+		if (node == tail)
+			break;
+
+		prev = node;
+		node = next;
+	}
+
+	old = __atomic_load_n(&queue->inbox, __ATOMIC_RELAXED);
+
+	do {
+		((sys_sfnode_t *)head)->next_and_flags = (unative_t)old;
+	} while (!__atomic_compare_exchange_n(&queue->inbox, &old, tail, true,
+					      __ATOMIC_SEQ_CST,
+					      __ATOMIC_RELAXED));
+
+	/* Wake only if the queue was empty; data_q is read after the node
+	 * is published, see the rules at the top of the file.
+	 */
+	if (old == NULL &&
+	    __atomic_load_n(&queue->data_q.head, __ATOMIC_SEQ_CST) == NULL)
+		handle_poll_events(queue, K_POLL_STATE_DATA_AVAILABLE);
 
-	handle_poll_events(queue, K_POLL_STATE_DATA_AVAILABLE);
 	return 0;
 }
 
 int k_queue_is_empty(struct k_queue *queue)
 {
-	return sys_sflist_is_empty(&queue->data_q);
+	k_spinlock_key_t key;
+	bool empty;
+
+	key = k_spin_lock(&queue->lock);
+	empty = queue_is_empty(queue);
+	k_spin_unlock(&queue->lock, key);
+
+	return empty;
 }
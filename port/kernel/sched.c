@@ -34,6 +34,7 @@
 #include <assert.h>
 #include <kernel.h>
 #include <arch/irq.h>
+#include <nuttx/arch.h>
 
 void k_sched_lock(void)
 {
@@ -78,6 +79,127 @@ bool arch_irq_unlocked(unsigned int key)
 	return false;
 }
 
+#ifdef CONFIG_IRQ_LOCK_HOST_SPINLOCK
+/* irq_lock() users only guard short, non-nesting sections that never
+ * block or wake a thread, so masking the local CPU and spinning on a
+ * lock word is enough. The global critical section and the scheduler
+ * lock stay with arch_irq_lock() and k_spin_lock().
+ *
+ * irq_lock() takes no lock object, so this is a single host-wide lock
+ * serializing all of its callers: the Bluetooth host's connection TX
+ * bookkeeping, its connection hash and its HCI command pipeline state.
+ * It only holds while a section never frees or wakes anything, never
+ * blocks and never takes irq_lock() again; IRQ_LOCK_STATS asserts the
+ * last one.
+ */
+static atomic_t host_irq_spin;
+
+#ifdef CONFIG_IRQ_LOCK_STATS
+static struct z_irq_lock_site *irq_sites;
+static struct z_irq_lock_site *irq_owner;
+static uint32_t irq_owner_start;
+#endif
+
+static inline irqstate_t irq_spin_acquire(bool *contended)
+{
+	irqstate_t flags = up_irq_save();
+
+	*contended = false;
+
+#ifdef CONFIG_SMP
+	while (__atomic_exchange_n(&host_irq_spin, 1, __ATOMIC_ACQUIRE)) {
+		*contended = true;
+	}
+#endif
+
+	return flags;
+}
+
+static inline void irq_spin_release(irqstate_t flags)
+{
+#ifdef CONFIG_SMP
+	__atomic_store_n(&host_irq_spin, 0, __ATOMIC_RELEASE);
+#endif
+
+	up_irq_restore(flags);
+}
+
+unsigned int z_irq_spin_lock(struct z_irq_lock_site *site)
+{
+	bool contended;
+	irqstate_t flags = irq_spin_acquire(&contended);
+
+#ifdef CONFIG_IRQ_LOCK_STATS
+	if (site->count++ == 0U) {
+		site->next = irq_sites;
+		irq_sites = site;
+	}
+
+	if (contended) {
+		site->contended++;
+	}
+
+	__ASSERT(irq_owner == NULL, "irq_lock() nested in %s:%u",
+		 irq_owner->func, irq_owner->line);
+
+	irq_owner = site;
+	irq_owner_start = (uint32_t)up_perf_gettime();
+#else
+	ARG_UNUSED(site);
+	ARG_UNUSED(contended);
+#endif
+
+	return flags;
+}
+
+void z_irq_spin_unlock(unsigned int key)
+{
+#ifdef CONFIG_IRQ_LOCK_STATS
+	struct z_irq_lock_site *site = irq_owner;
+	uint32_t hold = (uint32_t)up_perf_gettime() - irq_owner_start;
+
+	site->hold_total += hold;
+	if (hold > site->hold_max) {
+		site->hold_max = hold;
+	}
+
+	irq_owner = NULL;
+#endif
+
+	irq_spin_release(key);
+}
+
+#ifdef CONFIG_IRQ_LOCK_STATS
+void irq_lock_stats_dump(void)
+{
+	struct z_irq_lock_site *site, snap;
+	irqstate_t flags;
+	bool contended;
+
+	printk("irq_lock sites (hold times in %lu Hz cycles):\n",
+	       (unsigned long)up_perf_getfreq());
+
+	flags = irq_spin_acquire(&contended);
+	site = irq_sites;
+	irq_spin_release(flags);
+
+	/* Sites are only ever pushed at the head, so the chain below the
+	 * head read above is stable; snapshot each one under the lock and
+	 * print outside of it.
+	 */
+	for (; site != NULL; site = snap.next) {
+		flags = irq_spin_acquire(&contended);
+		snap = *site;
+		irq_spin_release(flags);
+
+		printk("  %s:%u count %u contended %u hold avg %u max %u\n",
+		       snap.func, snap.line, snap.count, snap.contended,
+		       (uint32_t)(snap.hold_total / snap.count), snap.hold_max);
+	}
+}
+#endif
+#endif /* CONFIG_IRQ_LOCK_HOST_SPINLOCK */
+
 void z_fatal_error(unsigned int reason, const z_arch_esf_t *esf)
 {
 	ASSERT(false);
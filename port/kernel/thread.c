@@ -83,19 +83,11 @@ static int nxthread_delete(pid_t pid)
 }
 
 
-extern struct k_work_q k_sys_work_q;
-
 k_tid_t z_current_get(void)
 {
 	struct k_thread *thread;
 	void *pid = (void *)getpid();
 
-#if !defined(CONFIG_ZEPHYR_WORK_QUEUE)
-	if (pid == k_sys_work_q.thread.init_data)
-		return &k_sys_work_q.thread;
-
-#endif /* !CONFIG_ZEPHYR_WORK_QUEUE */
-
 	SYS_SLIST_FOR_EACH_CONTAINER(&task_list, thread, node) {
 		if (thread->init_data == pid) {
 			return thread;
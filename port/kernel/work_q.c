@@ -34,90 +34,344 @@
 
 #include <kernel.h>
 #include <kernel_structs.h>
+#include <init.h>
+#include <ksched.h>
 
 #include <sys/types.h>
 #include <unistd.h>
 #include <string.h>
 
+static struct k_spinlock lock;
+
+static K_KERNEL_STACK_DEFINE(sys_work_q_stack,
+			     CONFIG_SYSTEM_WORKQUEUE_STACK_SIZE);
+
 struct k_work_q k_sys_work_q;
 
-static void work_cb(void *arg)
+static inline bool flag_test(const uint32_t *flagp, uint32_t bit)
+{
+	return (*flagp & BIT(bit)) != 0U;
+}
+
+static inline void flag_set(uint32_t *flagp, uint32_t bit)
+{
+	*flagp |= BIT(bit);
+}
+
+static inline void flag_clear(uint32_t *flagp, uint32_t bit)
+{
+	*flagp &= ~BIT(bit);
+}
+
+static inline int work_busy_get_locked(const struct k_work *work)
+{
+	return work->flags & K_WORK_MASK;
+}
+
+/* Append the work item to the queue and wake the queue thread.
+ *
+ * Invoked with the work lock held, possibly from the delay timer.
+ *
+ * @retval 0 if the work item was already queued
+ * @retval 1 if the work item was queued
+ * @retval -ENODEV if the queue has not been started
+ */
+static int submit_to_queue_locked(struct k_work *work,
+				  struct k_work_q *queue)
 {
-	struct k_work *work = arg;
+	if (flag_test(&work->flags, K_WORK_QUEUED_BIT)) {
+		return 0;
+	}
 
-	k_sys_work_q.thread.init_data = (void *)getpid();
+	/* Keep a running item on its queue so it never runs concurrently
+	 * with itself.
+	 */
+	if (flag_test(&work->flags, K_WORK_RUNNING_BIT)) {
+		queue = work->queue;
+	} else if (queue == NULL) {
+		queue = &k_sys_work_q;
+	}
 
-	if (work->handler) {
-		work->handler(work);
+	if (!flag_test(&queue->flags, K_WORK_QUEUE_STARTED_BIT)) {
+		return -ENODEV;
 	}
+
+	sys_slist_append(&queue->pending, &work->node);
+	flag_set(&work->flags, K_WORK_QUEUED_BIT);
+	work->queue = queue;
+
+	(void)z_sched_wake(&queue->notifyq, 0, NULL);
+
+	return 1;
 }
 
-static int work_submit(struct k_work_q *work_q,
-		       struct k_work *work,
-		       k_timeout_t delay)
+static void work_timeout(wdparm_t arg)
 {
-	if (work_available(&work->nwork)) {
-		work_queue(LPWORK, &work->nwork, work_cb, work, delay.ticks);
+	struct k_work_delayable *dwork = (struct k_work_delayable *)arg;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (flag_test(&dwork->work.flags, K_WORK_DELAYED_BIT)) {
+		flag_clear(&dwork->work.flags, K_WORK_DELAYED_BIT);
+		(void)submit_to_queue_locked(&dwork->work, dwork->queue);
 	}
 
-	return 0;
+	k_spin_unlock(&lock, key);
 }
 
-int k_work_cancel_delayable(struct k_work_delayable *dwork)
+static int schedule_for_queue_locked(struct k_work_q *queue,
+				     struct k_work_delayable *dwork,
+				     k_timeout_t delay)
 {
-	return work_cancel(LPWORK, &dwork->work.nwork);
+	if (K_TIMEOUT_EQ(delay, K_NO_WAIT)) {
+		return submit_to_queue_locked(&dwork->work, queue);
+	}
+
+	flag_set(&dwork->work.flags, K_WORK_DELAYED_BIT);
+	dwork->queue = queue;
+
+	(void)wd_start(&dwork->work.wdog, delay.ticks, work_timeout,
+		       (wdparm_t)dwork);
+
+	return 1;
 }
 
-bool k_work_cancel_delayable_sync(struct k_work_delayable *dwork,
-				  struct k_work_sync *sync)
+static bool unschedule_locked(struct k_work_delayable *dwork)
 {
-	return (bool)k_work_cancel_delayable(dwork);
+	if (!flag_test(&dwork->work.flags, K_WORK_DELAYED_BIT)) {
+		return false;
+	}
+
+	flag_clear(&dwork->work.flags, K_WORK_DELAYED_BIT);
+	(void)wd_cancel(&dwork->work.wdog);
+
+	return true;
 }
 
-int k_work_reschedule_for_queue(struct k_work_q *work_q,
-				struct k_work_delayable *dwork,
-				k_timeout_t delay)
+static void cancel_locked(struct k_work *work)
 {
-	k_work_cancel_delayable(dwork);
+	if (flag_test(&work->flags, K_WORK_QUEUED_BIT)) {
+		(void)sys_slist_find_and_remove(&work->queue->pending,
+						&work->node);
+		flag_clear(&work->flags, K_WORK_QUEUED_BIT);
+	}
+}
+
+static void work_queue_main(void *workq_ptr, void *p2, void *p3)
+{
+	struct k_work_q *queue = workq_ptr;
+	k_work_handler_t handler;
+	struct k_work *work;
+	k_spinlock_key_t key;
+	sys_snode_t *node;
+
+	for (;;) {
+		key = k_spin_lock(&lock);
+
+		node = sys_slist_get(&queue->pending);
+		if (node == NULL) {
+			(void)z_sched_wait(&lock, key, &queue->notifyq,
+					   K_FOREVER, NULL);
+			continue;
+		}
+
+		work = CONTAINER_OF(node, struct k_work, node);
+		flag_clear(&work->flags, K_WORK_QUEUED_BIT);
+		flag_set(&work->flags, K_WORK_RUNNING_BIT);
+		handler = work->handler;
+
+		k_spin_unlock(&lock, key);
+
+		handler(work);
+
+		key = k_spin_lock(&lock);
 
-	return work_submit(work_q, &dwork->work, delay);
+		flag_clear(&work->flags, K_WORK_RUNNING_BIT);
+
+		/* Release any k_work_cancel_delayable_sync() callers. */
+		while (z_sched_wake(&queue->drainq, 0, NULL)) {
+		}
+
+		k_spin_unlock(&lock, key);
+
+		if (!flag_test(&queue->flags, K_WORK_QUEUE_NO_YIELD_BIT)) {
+			k_yield();
+		}
+	}
 }
 
-int k_work_schedule(struct k_work_delayable *dwork,
-		    k_timeout_t delay)
+void k_work_queue_start(struct k_work_q *queue,
+			k_thread_stack_t *stack,
+			size_t stack_size,
+			int prio,
+			const struct k_work_queue_config *cfg)
 {
-	return work_submit(NULL, &dwork->work, delay);
+	uint32_t flags = K_WORK_QUEUE_STARTED;
+
+	__ASSERT_NO_MSG(queue);
+	__ASSERT_NO_MSG(stack);
+
+	sys_slist_init(&queue->pending);
+	sys_dlist_init(&queue->notifyq.waitq);
+	sys_dlist_init(&queue->drainq.waitq);
+
+	if ((cfg != NULL) && cfg->no_yield) {
+		flags |= K_WORK_QUEUE_NO_YIELD;
+	}
+
+	queue->flags = flags;
+
+	(void)k_thread_create(&queue->thread, stack, stack_size,
+			      work_queue_main, queue, NULL, NULL,
+			      prio, 0, K_NO_WAIT);
+
+	if ((cfg != NULL) && (cfg->name != NULL)) {
+		k_thread_name_set(&queue->thread, cfg->name);
+	}
 }
 
-int k_work_reschedule(struct k_work_delayable *dwork,
-		      k_timeout_t delay)
+static int k_sys_work_q_init(const struct device *dev)
 {
-	return k_work_reschedule_for_queue(NULL, dwork, delay);
+	struct k_work_queue_config cfg = {
+		.name = "sysworkq",
+		.no_yield = IS_ENABLED(CONFIG_SYSTEM_WORKQUEUE_NO_YIELD),
+	};
+
+	ARG_UNUSED(dev);
+
+	k_work_queue_start(&k_sys_work_q,
+			   sys_work_q_stack,
+			   K_KERNEL_STACK_SIZEOF(sys_work_q_stack),
+			   CONFIG_SYSTEM_WORKQUEUE_PRIORITY, &cfg);
+
+	return 0;
 }
 
+SYS_INIT(k_sys_work_q_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
+
 void k_work_init(struct k_work *work, k_work_handler_t handler)
 {
 	memset(work, 0, sizeof(*work));
 	work->handler = handler;
 }
 
-int k_work_submit_to_queue(struct k_work_q *work_q, struct k_work *work)
+int k_work_busy_get(const struct k_work *work)
 {
-	return work_submit(work_q, work, K_NO_WAIT);
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int ret = work_busy_get_locked(work);
+
+	k_spin_unlock(&lock, key);
+
+	return ret;
+}
+
+int k_work_submit_to_queue(struct k_work_q *queue, struct k_work *work)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int ret = submit_to_queue_locked(work, queue);
+
+	k_spin_unlock(&lock, key);
+
+	return ret;
 }
 
 int k_work_submit(struct k_work *work)
 {
-	return k_work_submit_to_queue(NULL, work);
+	return k_work_submit_to_queue(&k_sys_work_q, work);
 }
 
 void k_work_init_delayable(struct k_work_delayable *dwork,
 			   k_work_handler_t handler)
 {
-	k_work_init(&dwork->work, handler);
+	memset(dwork, 0, sizeof(*dwork));
+	dwork->work.handler = handler;
+	dwork->work.flags = K_WORK_DELAYABLE;
 }
 
 int k_work_delayable_busy_get(const struct k_work_delayable *dwork)
 {
-	return !work_available(&dwork->work.nwork);
+	return k_work_busy_get(&dwork->work);
+}
+
+int k_work_schedule_for_queue(struct k_work_q *queue,
+			      struct k_work_delayable *dwork,
+			      k_timeout_t delay)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int ret = 0;
+
+	if ((work_busy_get_locked(&dwork->work) &
+	     (K_WORK_DELAYED | K_WORK_QUEUED)) == 0U) {
+		ret = schedule_for_queue_locked(queue, dwork, delay);
+	}
+
+	k_spin_unlock(&lock, key);
+
+	return ret;
+}
+
+int k_work_schedule(struct k_work_delayable *dwork,
+		    k_timeout_t delay)
+{
+	return k_work_schedule_for_queue(&k_sys_work_q, dwork, delay);
+}
+
+int k_work_reschedule_for_queue(struct k_work_q *queue,
+				struct k_work_delayable *dwork,
+				k_timeout_t delay)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int ret;
+
+	(void)unschedule_locked(dwork);
+	ret = schedule_for_queue_locked(queue, dwork, delay);
+
+	k_spin_unlock(&lock, key);
+
+	return ret;
+}
+
+int k_work_reschedule(struct k_work_delayable *dwork,
+		      k_timeout_t delay)
+{
+	return k_work_reschedule_for_queue(&k_sys_work_q, dwork, delay);
+}
+
+int k_work_cancel_delayable(struct k_work_delayable *dwork)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int ret;
+
+	(void)unschedule_locked(dwork);
+	cancel_locked(&dwork->work);
+	ret = work_busy_get_locked(&dwork->work);
+
+	k_spin_unlock(&lock, key);
+
+	return ret;
+}
+
+bool k_work_cancel_delayable_sync(struct k_work_delayable *dwork,
+				  struct k_work_sync *sync)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	struct k_work_q *queue = dwork->work.queue;
+	bool pending;
+
+	ARG_UNUSED(sync);
+
+	pending = work_busy_get_locked(&dwork->work) != 0;
+
+	(void)unschedule_locked(dwork);
+	cancel_locked(&dwork->work);
+
+	/* Wait for a running handler to return, unless it is the caller. */
+	while (flag_test(&dwork->work.flags, K_WORK_RUNNING_BIT) &&
+	       k_current_get() != &queue->thread) {
+		(void)z_sched_wait(&lock, key, &queue->drainq, K_FOREVER, NULL);
+		key = k_spin_lock(&lock);
+	}
+
+	k_spin_unlock(&lock, key);
+
+	return pending;
 }
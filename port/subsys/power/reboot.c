@@ -17,7 +17,7 @@
 
 void sys_reboot(int type)
 {
-	(void)irq_lock();
+	(void)arch_irq_lock();
 
 #if defined(CONFIG_BOARDCTL_RESET)
 	boardctl(BOARDIOC_RESET, type);
@@ -0,0 +1,292 @@
+/****************************************************************************
+ *
+ *   Copyright (C) 2020 Xiaomi InC. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <kernel.h>
+#include <sys/byteorder.h>
+
+#include "../../drivers/bluetooth/hci/h4_common.h"
+
+#define RX_BUF_SIZE 1024
+
+/* Typical traffic of a controller scanning while one connection streams
+ * notifications: legacy and extended advertising reports, ACL data and
+ * Number Of Completed Packets events. A raw capture can be given instead.
+ */
+static const uint8_t stream_rec[] = {
+	/* LE Advertising Report, ADV_IND, 31 bytes of AD */
+	0x04, 0x3e, 0x2b, 0x02, 0x01, 0x00, 0x00, 0x5c, 0x3a, 0x21, 0x9e, 0x4f,
+	0xd0, 0x1f, 0x02, 0x01, 0x06, 0x03, 0x03, 0xaa, 0xfe, 0x17, 0x16, 0xaa,
+	0xfe, 0x10, 0xf4, 0x03, 0x67, 0x6f, 0x6f, 0x2e, 0x67, 0x6c, 0x2f, 0x50,
+	0x48, 0x4e, 0x53, 0x64, 0x6d, 0x00, 0x00, 0x00, 0x00, 0xb8,
+	/* LE Advertising Report, ADV_NONCONN_IND, 30 bytes of AD */
+	0x04, 0x3e, 0x2a, 0x02, 0x01, 0x03, 0x00, 0x11, 0x84, 0x3f, 0x6a, 0x12,
+	0x7c, 0x1e, 0x1d, 0xff, 0x06, 0x00, 0x01, 0x09, 0x20, 0x02, 0x4a, 0x55,
+	0x1f, 0xd6, 0x2e, 0x6b, 0x30, 0x9b, 0x77, 0xc3, 0x24, 0x8e, 0x01, 0x5d,
+	0x91, 0x7e, 0x0a, 0xb3, 0x42, 0xa4, 0xc2, 0xaf, 0xaf,
+	/* LE Extended Advertising Report, 1M, 18 bytes of AD */
+	0x04, 0x3e, 0x2d, 0x0d, 0x01, 0x13, 0x00, 0x00, 0x7e, 0x40, 0x2c, 0x08,
+	0x91, 0xe4, 0x01, 0x00, 0xff, 0x7f, 0xb2, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x12, 0x02, 0x01, 0x1a, 0x0e, 0x09, 0x4d,
+	0x69, 0x20, 0x53, 0x6d, 0x61, 0x72, 0x74, 0x20, 0x42, 0x61, 0x6e, 0x64,
+	/* ACL, handle 0x0001, ATT Handle Value Notification, 20 bytes */
+	0x02, 0x01, 0x20, 0x1b, 0x00, 0x17, 0x00, 0x04, 0x00, 0x1b, 0x12, 0x00,
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b,
+	0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13,
+	/* Number Of Completed Packets, handle 0x0001, 1 packet */
+	0x04, 0x13, 0x05, 0x01, 0x01, 0x00, 0x01, 0x00,
+	/* LE Advertising Report, SCAN_RSP, 9 bytes of AD */
+	0x04, 0x3e, 0x15, 0x02, 0x01, 0x04, 0x00, 0x5c, 0x3a, 0x21, 0x9e, 0x4f,
+	0xd0, 0x09, 0x08, 0x09, 0x42, 0x65, 0x61, 0x63, 0x6f, 0x6e, 0x30, 0xb4,
+};
+
+struct bench_src {
+	int fd;
+	uint32_t reads;
+};
+
+static const uint8_t *stream = stream_rec;
+static size_t stream_len = sizeof(stream_rec);
+static int iterations = 2000;
+static int pkts_per_stream;
+
+static ssize_t bench_read(void *ctx, uint8_t *buf, size_t len)
+{
+	struct bench_src *src = ctx;
+	ssize_t ret;
+
+	src->reads++;
+
+	ret = read(src->fd, buf, len);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static void *writer(void *arg)
+{
+	int fd = (int)(intptr_t)arg;
+	const uint8_t *p;
+	size_t left;
+	ssize_t ret;
+
+	for (int i = 0; i < iterations; i++) {
+		for (p = stream, left = stream_len; left; p += ret, left -= ret) {
+			ret = write(fd, p, left);
+			if (ret < 0) {
+				goto out;
+			}
+		}
+	}
+
+out:
+	close(fd);
+
+	return NULL;
+}
+
+static int count_pkts(const uint8_t *data, size_t len)
+{
+	size_t off = 0;
+	int pkts = 0;
+
+	while (off < len) {
+		switch (data[off]) {
+		case H4_EVT:
+			off += 1 + 2 + data[off + 2];
+			break;
+		case H4_ACL:
+		case H4_ISO:
+			off += 1 + 4 + sys_get_le16(&data[off + 3]);
+			break;
+		default:
+			return -EINVAL;
+		}
+
+		pkts++;
+	}
+
+	return off == len ? pkts : -EINVAL;
+}
+
+static int run(const char *name, uint8_t *rx_data, size_t rx_size)
+{
+	static uint8_t payload[CONFIG_BT_BUF_ACL_RX_SIZE + 256];
+	struct bench_src src = { 0 };
+	struct timespec start, end;
+	struct h4_rx_buf rx;
+	struct h4_rx_hdr hdr;
+	uint64_t bytes = 0;
+	pthread_t tid;
+	uint32_t pkts = 0;
+	uint64_t us;
+	int fds[2];
+	int ret;
+
+	if (pipe(fds) < 0) {
+		return -errno;
+	}
+
+	src.fd = fds[0];
+	h4_rx_buf_init(&rx, bench_read, &src, rx_data, rx_size);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pthread_create(&tid, NULL, writer, (void *)(intptr_t)fds[1]);
+
+	for (;;) {
+		ret = h4_rx_hdr_read(&rx, &hdr);
+		if (ret == -EAGAIN) {
+			continue;
+		} else if (ret < 0) {
+			break;
+		}
+
+		if (hdr.data_len > sizeof(payload)) {
+			ret = -EMSGSIZE;
+			break;
+		}
+
+		ret = h4_rx_read(&rx, payload, hdr.data_len);
+		if (ret < 0) {
+			break;
+		}
+
+		bytes += 1 + hdr.hdr_len + hdr.data_len;
+		pkts++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	pthread_join(tid, NULL);
+	close(fds[0]);
+
+	us = (end.tv_sec - start.tv_sec) * 1000000ULL +
+	     (end.tv_nsec - start.tv_nsec) / 1000;
+	if (!us) {
+		us = 1;
+	}
+
+	printk("%-10s: %lu pkts %llu bytes in %llu us, %lu reads, "
+	       "%llu pkts/s, %llu KiB/s\n", name, pkts, bytes, us, src.reads,
+	       pkts * 1000000ULL / us, bytes * 1000000ULL / 1024 / us);
+
+	if (pkts != (uint32_t)pkts_per_stream * iterations) {
+		printk("%s: framed %lu packets, expected %lu\n", name, pkts,
+		       (uint32_t)pkts_per_stream * iterations);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int load(const char *path)
+{
+	uint8_t *data;
+	off_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -errno;
+	}
+
+	len = lseek(fd, 0, SEEK_END);
+	lseek(fd, 0, SEEK_SET);
+
+	data = malloc(len);
+	if (data == NULL) {
+		close(fd);
+		return -ENOMEM;
+	}
+
+	if (read(fd, data, len) != len) {
+		free(data);
+		close(fd);
+		return -EIO;
+	}
+
+	close(fd);
+
+	stream = data;
+	stream_len = len;
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static uint8_t rx_data[RX_BUF_SIZE];
+	int err;
+
+	/* test_h4_rx [iterations] [raw H:4 capture] */
+	if (argc >= 2) {
+		iterations = atoi(argv[1]);
+	}
+
+	if (argc >= 3) {
+		err = load(argv[2]);
+		if (err) {
+			printk("Unable to load %s (err %d)\n", argv[2], err);
+			return err;
+		}
+	}
+
+	pkts_per_stream = count_pkts(stream, stream_len);
+	if (pkts_per_stream <= 0) {
+		printk("Malformed H:4 stream\n");
+		return -EINVAL;
+	}
+
+	printk("%d x %zu bytes, %d packets each\n", iterations, stream_len,
+	       pkts_per_stream);
+
+	err = run("unbuffered", NULL, 0);
+	if (err) {
+		return err;
+	}
+
+	err = run("buffered", rx_data, sizeof(rx_data));
+	if (err) {
+		return err;
+	}
+
+	printk("PASSED\n");
+
+	return 0;
+}
@@ -0,0 +1,257 @@
+/****************************************************************************
+ *
+ *   Copyright (C) 2020 Xiaomi InC. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <kernel.h>
+#include <sys/byteorder.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/crypto.h>
+
+#include "common/rpa.h"
+#include "keys.h"
+
+#define BONDS           MIN(32, CONFIG_BT_MAX_PAIRED)
+#define NEARBY_BONDS    4
+#define REPORTS_PER_SEC 1000
+
+struct advertiser {
+	bt_addr_le_t addr;
+	struct bt_keys *keys;
+};
+
+static uint8_t irks[BONDS][16];
+static struct bt_keys *bond_keys[BONDS];
+static struct advertiser *adv;
+static int unknown = 40;
+static int seconds = 10;
+static uint32_t seed = 0x2545f491;
+
+static uint32_t rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+
+	return seed;
+}
+
+static void rpa_make(const uint8_t irk[16], bt_addr_le_t *addr)
+{
+	uint8_t r[16] = { 0 };
+	uint32_t prand = rnd();
+
+	addr->type = BT_ADDR_LE_RANDOM;
+	sys_put_le24(prand, &addr->a.val[3]);
+	BT_ADDR_SET_RPA(&addr->a);
+
+	/* ah(irk, prand) is the low 24 bits of e(irk, padding || prand) */
+	memcpy(r, &addr->a.val[3], 3);
+	bt_encrypt_le(irk, r, r);
+	memcpy(addr->a.val, r, 3);
+}
+
+static int bonds_add(void)
+{
+	bt_addr_le_t id_addr;
+	struct bt_keys *keys;
+	int i;
+
+	for (i = 0; i < BONDS; i++) {
+		id_addr.type = BT_ADDR_LE_PUBLIC;
+		sys_put_le32(rnd(), &id_addr.a.val[0]);
+		sys_put_le16(i, &id_addr.a.val[4]);
+
+		keys = bt_keys_get_type(BT_KEYS_IRK, BT_ID_DEFAULT, &id_addr);
+		if (!keys) {
+			return -ENOMEM;
+		}
+
+		sys_put_le32(rnd(), &irks[i][0]);
+		sys_put_le32(rnd(), &irks[i][4]);
+		sys_put_le32(rnd(), &irks[i][8]);
+		sys_put_le32(rnd(), &irks[i][12]);
+
+		memcpy(keys->irk.val, irks[i], 16);
+		bt_keys_rpa_cache_clear();
+
+		bond_keys[i] = keys;
+
+		if (i < NEARBY_BONDS) {
+			adv[i].keys = keys;
+		}
+	}
+
+	return 0;
+}
+
+/* Advertisers in range: a few bonded peers among many unknown devices, all
+ * using RPAs. Half of them rotate their address halfway through the run.
+ */
+static void adv_rotate(int from, int step)
+{
+	int i;
+
+	for (i = from; i < NEARBY_BONDS + unknown; i += step) {
+		if (i < NEARBY_BONDS) {
+			rpa_make(irks[i], &adv[i].addr);
+		} else {
+			uint8_t irk[16];
+
+			sys_put_le32(rnd(), &irk[0]);
+			sys_put_le32(rnd(), &irk[4]);
+			sys_put_le32(rnd(), &irk[8]);
+			sys_put_le32(rnd(), &irk[12]);
+			rpa_make(irk, &adv[i].addr);
+		}
+	}
+}
+
+/* Resolution as done before the cache: one AES operation per bonded IRK for
+ * every report from an unknown RPA.
+ */
+static struct bt_keys *linear_find_irk(const bt_addr_le_t *addr)
+{
+	int i;
+
+	for (i = 0; i < BONDS; i++) {
+		if (bt_rpa_irk_matches(irks[i], &addr->a)) {
+			return bond_keys[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int run(const char *name,
+	       struct bt_keys *(*find)(const bt_addr_le_t *addr))
+{
+	uint32_t reports = seconds * REPORTS_PER_SEC;
+	struct timespec start, end;
+	uint32_t resolved = 0;
+	struct advertiser *a;
+	struct bt_keys *keys;
+	uint32_t i;
+	uint64_t us;
+
+	seed = 0x2545f491;
+	adv_rotate(0, 1);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < reports; i++) {
+		if (i == reports / 2) {
+			adv_rotate(0, 2);
+		}
+
+		a = &adv[rnd() % (NEARBY_BONDS + unknown)];
+
+		keys = find(&a->addr);
+		if (keys != a->keys) {
+			printk("%s: %s resolved wrongly\n", name,
+			       bt_addr_le_str(&a->addr));
+			return -EIO;
+		}
+
+		resolved += !!keys;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	us = (end.tv_sec - start.tv_sec) * 1000000ULL +
+	     (end.tv_nsec - start.tv_nsec) / 1000;
+	if (!us) {
+		us = 1;
+	}
+
+	printk("%-8s: %lu reports (%lu resolved) in %llu us, %llu ns/report, "
+	       "%llu.%02llu%% CPU at %d reports/s\n", name, reports, resolved,
+	       us, us * 1000 / reports, us * 100 / (seconds * 1000000ULL),
+	       us * 10000 / (seconds * 1000000ULL) % 100, REPORTS_PER_SEC);
+
+	return 0;
+}
+
+static struct bt_keys *cached_find_irk(const bt_addr_le_t *addr)
+{
+	return bt_keys_find_irk(BT_ID_DEFAULT, addr);
+}
+
+int main(int argc, char *argv[])
+{
+	int err;
+
+	/* test_rpa_cache [unknown advertisers] [seconds of scanning] */
+	if (argc >= 2) {
+		unknown = atoi(argv[1]);
+	}
+
+	if (argc >= 3) {
+		seconds = atoi(argv[2]);
+	}
+
+	adv = calloc(NEARBY_BONDS + unknown, sizeof(*adv));
+	if (adv == NULL) {
+		return -ENOMEM;
+	}
+
+	err = bonds_add();
+	if (err) {
+		printk("Unable to add bonds (err %d)\n", err);
+		goto out;
+	}
+
+	printk("%d bonds, %d bonded and %d unknown advertisers, %d s at "
+	       "%d reports/s, %d cache entries\n", BONDS, NEARBY_BONDS,
+	       unknown, seconds, REPORTS_PER_SEC, CONFIG_BT_RPA_CACHE_SIZE);
+
+	err = run("linear", linear_find_irk);
+	if (err) {
+		goto out;
+	}
+
+	err = run("cached", cached_find_irk);
+	if (err) {
+		goto out;
+	}
+
+	printk("PASSED\n");
+
+out:
+	free(adv);
+
+	return err;
+}
@@ -0,0 +1,107 @@
+/****************************************************************************
+ *
+ *   Copyright (C) 2020 Xiaomi InC. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <kernel.h>
+
+#define NUM_THREADS 2
+
+static K_KERNEL_STACK_ARRAY_DEFINE(stacks, NUM_THREADS, 1024);
+
+static struct k_thread threads_data[NUM_THREADS];
+
+static K_SEM_DEFINE(done, 0, NUM_THREADS);
+
+static volatile uint32_t counter;
+
+static int count = 100000;
+
+static void thread(void *p1, void *p2, void *p3)
+{
+	unsigned int key;
+	uint32_t val;
+
+	printk("start %s %lu\n", __FUNCTION__, k_uptime_get_32());
+
+	for (int i = 0; i < count; i++) {
+		key = irq_lock();
+		val = counter;
+		counter = val + 1;
+		irq_unlock(key);
+
+		if ((i & 0xff) == 0) {
+			k_yield();
+		}
+	}
+
+	printk("end %s %lu\n", __FUNCTION__, k_uptime_get_32());
+
+	k_sem_give(&done);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int key;
+	int i;
+
+	if (argc == 2) {
+		count = atoi(argv[1]);
+	}
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		k_thread_create(&threads_data[i], stacks[i],
+				K_KERNEL_STACK_SIZEOF(stacks[i]),
+				(k_thread_entry_t)thread, NULL, NULL, NULL,
+				K_PRIO_PREEMPT(0), 0, K_NO_WAIT);
+	}
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		k_sem_take(&done, K_FOREVER);
+	}
+
+	key = irq_lock();
+	__ASSERT_NO_MSG(counter == NUM_THREADS * count);
+	irq_unlock(key);
+
+	printk("counter %u\n", counter);
+
+#ifdef CONFIG_IRQ_LOCK_STATS
+	irq_lock_stats_dump();
+#endif
+
+	printk("PASSED\n");
+
+	return 0;
+}
@@ -106,6 +106,11 @@ static void thread2(void *p1, void *p2, void *p3)
 
 	printk("end %s %lu\n", __FUNCTION__, k_uptime_get_32());
 
+	printk("used %u max %u failed %u\n", k_mem_slab_num_used_get(&mslab1),
+	       k_mem_slab_max_used_get(&mslab1),
+	       k_mem_slab_num_failed_get(&mslab1));
+	__ASSERT_NO_MSG(k_mem_slab_num_failed_get(&mslab1) == 2 * count);
+
 	printk("PASSED\n");
 }
 
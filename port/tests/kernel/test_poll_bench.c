@@ -0,0 +1,236 @@
+/****************************************************************************
+ *
+ *   Copyright (C) 2020 Xiaomi InC. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <kernel.h>
+#include <logging/log.h>
+
+#define MAX_CONN 64
+
+/* Mirrors hci_tx_thread: one command FIFO, the conn_change signal and one
+ * TX FIFO per connection, all re-armed and polled on every iteration.
+ */
+#define EV_COUNT (2 + MAX_CONN)
+
+struct item {
+	void *fifo_reserved;
+	int conn;
+};
+
+static K_KERNEL_STACK_DEFINE(tx_stack, 2048);
+static K_KERNEL_STACK_DEFINE(producer_stack, 2048);
+static K_KERNEL_STACK_DEFINE(waiter_stack1, 1024);
+static K_KERNEL_STACK_DEFINE(waiter_stack2, 1024);
+
+static struct k_thread tx_thread_data;
+static struct k_thread producer_thread_data;
+static struct k_thread waiter_thread_data1;
+static struct k_thread waiter_thread_data2;
+
+static K_SEM_DEFINE(ack, 0, 1);
+static K_SEM_DEFINE(done, 0, 3);
+
+static struct k_poll_signal conn_change =
+		K_POLL_SIGNAL_INITIALIZER(conn_change);
+static struct k_poll_signal shared =
+		K_POLL_SIGNAL_INITIALIZER(shared);
+
+static struct k_queue cmd_queue;
+static struct k_queue conn_queue[MAX_CONN];
+static struct item items[MAX_CONN];
+
+static int num_conn = 32;
+static int iterations = 10000;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void tx_thread(void *p1, void *p2, void *p3)
+{
+	static struct k_poll_event events[EV_COUNT];
+	int ev_count, err, fired;
+	struct item *item;
+
+	for (int n = 0; n < iterations; ) {
+		ev_count = 0;
+
+		k_poll_event_init(&events[ev_count++],
+				  K_POLL_TYPE_FIFO_DATA_AVAILABLE,
+				  K_POLL_MODE_NOTIFY_ONLY, &cmd_queue);
+		k_poll_event_init(&events[ev_count++], K_POLL_TYPE_SIGNAL,
+				  K_POLL_MODE_NOTIFY_ONLY, &conn_change);
+
+		for (int i = 0; i < num_conn; i++) {
+			k_poll_event_init(&events[ev_count++],
+					  K_POLL_TYPE_FIFO_DATA_AVAILABLE,
+					  K_POLL_MODE_NOTIFY_ONLY,
+					  &conn_queue[i]);
+		}
+
+		err = k_poll(events, ev_count, K_FOREVER);
+		__ASSERT_NO_MSG(err == 0);
+
+		fired = 0;
+
+		for (int i = 2; i < ev_count; i++) {
+			if (events[i].state != K_POLL_STATE_FIFO_DATA_AVAILABLE) {
+				continue;
+			}
+
+			item = k_queue_get(&conn_queue[i - 2], K_NO_WAIT);
+			__ASSERT_NO_MSG(item && item->conn == i - 2);
+			fired++;
+			n++;
+		}
+
+		__ASSERT_NO_MSG(fired == 1);
+
+		k_sem_give(&ack);
+	}
+
+	k_sem_give(&done);
+}
+
+static void producer_thread(void *p1, void *p2, void *p3)
+{
+	uint64_t start, us;
+	int conn;
+
+	start = now_us();
+
+	for (int n = 0; n < iterations; n++) {
+		/* Feed the last connection most often: it is registered
+		 * last, so it is the worst case for a linear scan.
+		 */
+		conn = (n & 3) ? num_conn - 1 : n % num_conn;
+
+		k_queue_append(&conn_queue[conn], &items[conn]);
+		k_sem_take(&ack, K_FOREVER);
+	}
+
+	us = now_us() - start;
+	if (!us) {
+		us = 1;
+	}
+
+	printk("%d conns: %d wakeups in %llu us, %llu ns/wakeup, %llu wakeups/s\n",
+	       num_conn, iterations, us, us * 1000ULL / iterations,
+	       iterations * 1000000ULL / us);
+
+	k_sem_give(&done);
+}
+
+static void waiter_thread(void *p1, void *p2, void *p3)
+{
+	struct k_poll_event event;
+	int err;
+
+	k_poll_event_init(&event, K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY,
+			  &shared);
+
+	err = k_poll(&event, 1, K_MSEC(1000));
+	printk("waiter %d woken err %d state %u\n", (int)(intptr_t)p1, err,
+	       event.state);
+	__ASSERT_NO_MSG((err == 0) && (event.state == K_POLL_STATE_SIGNALED));
+
+	k_sem_give(&done);
+}
+
+int main(int argc, char *argv[])
+{
+	/* test_poll_bench [connections] [iterations] */
+	if (argc >= 2) {
+		num_conn = atoi(argv[1]);
+	}
+
+	if (argc >= 3) {
+		iterations = atoi(argv[2]);
+	}
+
+	if (num_conn < 1 || num_conn > MAX_CONN) {
+		printk("connections must be within 1..%d\n", MAX_CONN);
+		return -EINVAL;
+	}
+
+	printk("#Test k_poll wakes every waiter on one object\n");
+
+	k_thread_create(&waiter_thread_data1, waiter_stack1,
+			K_KERNEL_STACK_SIZEOF(waiter_stack1),
+			(k_thread_entry_t)waiter_thread, (void *)1, NULL, NULL,
+			K_PRIO_COOP(0), 0, K_NO_WAIT);
+	k_thread_create(&waiter_thread_data2, waiter_stack2,
+			K_KERNEL_STACK_SIZEOF(waiter_stack2),
+			(k_thread_entry_t)waiter_thread, (void *)2, NULL, NULL,
+			K_PRIO_COOP(0), 0, K_NO_WAIT);
+
+	k_sleep(K_MSEC(100));
+	k_poll_signal_raise(&shared, 0);
+
+	k_sem_take(&done, K_FOREVER);
+	k_sem_take(&done, K_FOREVER);
+
+	printk("#Test k_poll with %d connections\n", num_conn);
+
+	k_queue_init(&cmd_queue);
+	for (int i = 0; i < num_conn; i++) {
+		k_queue_init(&conn_queue[i]);
+		items[i].conn = i;
+	}
+
+	k_thread_create(&tx_thread_data, tx_stack,
+			K_KERNEL_STACK_SIZEOF(tx_stack),
+			(k_thread_entry_t)tx_thread, NULL, NULL, NULL,
+			K_PRIO_COOP(0), 0, K_NO_WAIT);
+	k_thread_name_set(&tx_thread_data, "poll tx");
+
+	k_thread_create(&producer_thread_data, producer_stack,
+			K_KERNEL_STACK_SIZEOF(producer_stack),
+			(k_thread_entry_t)producer_thread, NULL, NULL, NULL,
+			K_PRIO_COOP(0), 0, K_NO_WAIT);
+	k_thread_name_set(&producer_thread_data, "poll producer");
+
+	k_sem_take(&done, K_FOREVER);
+	k_sem_take(&done, K_FOREVER);
+
+	printk("PASSED\n");
+
+	return 0;
+}
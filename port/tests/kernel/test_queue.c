@@ -116,11 +116,32 @@ static void thread1(void *p1, void *p2, void *p3)
 
 		k_sem_give(&sem2);
 	}
+
+	for (int i = 1; i <= count; i++) {
+		printk("#%d Test queue get with list append then append\n", i);
+		data = k_queue_get(&queue1, K_FOREVER);
+		__ASSERT_NO_MSG(data != NULL);
+		__ASSERT_NO_MSG(data->data == i);
+
+		data = k_queue_get(&queue1, K_FOREVER);
+		__ASSERT_NO_MSG(data != NULL);
+		__ASSERT_NO_MSG(data->data == i + count);
+
+		data = k_queue_get(&queue1, K_FOREVER);
+		__ASSERT_NO_MSG(data != NULL);
+		__ASSERT_NO_MSG(data->data == i + count + count);
+
+		__ASSERT_NO_MSG(k_queue_is_empty(&queue1));
+
+		k_sem_give(&sem2);
+	}
 	printk("end %s %lu\n", __FUNCTION__, k_uptime_get_32());
 }
 
 static void thread2(void *p1, void *p2, void *p3)
 {
+	sys_slist_t list;
+
 	printk("start %s %lu\n", __FUNCTION__, k_uptime_get_32());
 
 	for (int i = 1; i <= count; i++) {
@@ -159,6 +180,22 @@ static void thread2(void *p1, void *p2, void *p3)
 		k_sem_take(&sem2, K_FOREVER);
 	}
 
+	for (int i = 1; i <= count; i++) {
+		__ASSERT_NO_MSG(k_queue_is_empty(&queue1));
+
+		data.data = i;
+		data1.data = i + count;
+		sys_slist_init(&list);
+		sys_slist_append(&list, &data.snode);
+		sys_slist_append(&list, &data1.snode);
+		k_queue_append_list(&queue1, list.head, list.tail);
+
+		data2.data = i + count + count;
+		k_queue_append(&queue1, &data2.snode);
+
+		k_sem_take(&sem2, K_FOREVER);
+	}
+
 	printk("end %s %lu\n", __FUNCTION__, k_uptime_get_32());
 
 	printk("PASSED\n");
@@ -47,6 +47,21 @@ static void k_work_handler_1(struct k_work *work)
 
 static K_WORK_DELAYABLE_DEFINE(work1, k_work_handler_1);
 
+static K_KERNEL_STACK_DEFINE(workq_stack, 2048);
+static struct k_work_q workq;
+
+static void k_work_handler_2(struct k_work *work)
+{
+	printk("#handler on %s queue:%lums \n",
+	       k_current_get() == &workq.thread ? "own" : "wrong",
+	       k_uptime_get_32());
+	__ASSERT_NO_MSG(k_current_get() == &workq.thread);
+
+	k_sem_give(&sem);
+}
+
+static K_WORK_DEFINE(work2, k_work_handler_2);
+
 int main(int argc, char *argv[])
 {
 	int count = 1;
@@ -143,6 +158,23 @@ int main(int argc, char *argv[])
 		       k_work_delayable_remaining_get(&work1), k_uptime_get_32());
 	}
 
+	printk("#Test k_work_submit_to_queue\n");
+
+	k_work_queue_start(&workq, workq_stack,
+			   K_KERNEL_STACK_SIZEOF(workq_stack),
+			   CONFIG_SYSTEM_WORKQUEUE_PRIORITY + 1, NULL);
+	k_thread_name_set(&workq.thread, "test workq");
+
+	for (int i = 1; i <= count; i++) {
+		printk("#%d time:%lums \n", i, k_uptime_get_32());
+
+		err = k_work_submit_to_queue(&workq, &work2);
+		__ASSERT_NO_MSG(err == 1);
+
+		err = k_sem_take(&sem, K_FOREVER);
+		__ASSERT_NO_MSG(err == 0);
+	}
+
 	printk("PASSED\n");
 
 	return 0;
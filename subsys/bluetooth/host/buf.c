@@ -38,6 +38,17 @@
 NET_BUF_POOL_FIXED_DEFINE(num_complete_pool, 1, NUM_COMLETE_EVENT_SIZE, 8, NULL);
 #endif /* CONFIG_BT_CONN || CONFIG_BT_ISO */
 
+#if CONFIG_BT_HCI_CMD_PIPELINE > 1
+/* Dedicated pool for Command Complete and Command Status events once they
+ * can no longer be received into the command buffer. Each outstanding
+ * command gets at most one of them, plus the one still being handled
+ * after it released its command credit, so exhaustion of the RX pool
+ * cannot hold back a response the host is waiting for.
+ */
+NET_BUF_POOL_FIXED_DEFINE(cmd_complete_pool, CONFIG_BT_HCI_CMD_PIPELINE + 1,
+			  BT_BUF_EVT_RX_SIZE, 8, NULL);
+#endif /* CONFIG_BT_HCI_CMD_PIPELINE > 1 */
+
 #if defined(CONFIG_BT_BUF_EVT_DISCARDABLE_COUNT)
 NET_BUF_POOL_FIXED_DEFINE(discardable_pool, CONFIG_BT_BUF_EVT_DISCARDABLE_COUNT,
 			  BT_BUF_EVT_SIZE(CONFIG_BT_BUF_EVT_DISCARDABLE_SIZE), 8,
@@ -93,8 +104,11 @@ struct net_buf *bt_buf_get_cmd_complete(k_timeout_t timeout)
 {
 	struct net_buf *buf;
 
-	if (bt_dev.sent_cmd) {
-		buf = net_buf_ref(bt_dev.sent_cmd);
+	/* With a single command in flight the response belongs to it, so
+	 * the event can be received straight into the command buffer.
+	 */
+	if (CONFIG_BT_HCI_CMD_PIPELINE == 1 && bt_dev.sent_cmd[0]) {
+		buf = net_buf_ref(bt_dev.sent_cmd[0]);
 
 		bt_buf_set_type(buf, BT_BUF_EVT);
 		buf->len = 0U;
@@ -103,9 +117,44 @@ struct net_buf *bt_buf_get_cmd_complete(k_timeout_t timeout)
 		return buf;
 	}
 
+#if CONFIG_BT_HCI_CMD_PIPELINE > 1
+	/* Unsolicited completions, such as for NOP, may find the pool
+	 * empty and fall back to the RX pool.
+	 */
+	buf = net_buf_alloc(&cmd_complete_pool, K_NO_WAIT);
+	if (buf) {
+		net_buf_reserve(buf, BT_BUF_RESERVE);
+		bt_buf_set_type(buf, BT_BUF_EVT);
+
+		return buf;
+	}
+#endif /* CONFIG_BT_HCI_CMD_PIPELINE > 1 */
+
 	return bt_buf_get_rx(BT_BUF_EVT, timeout);
 }
 
+void bt_buf_view_destroy(struct net_buf *buf)
+{
+	struct net_buf *parent = *(struct net_buf **)buf->user_data;
+
+	net_buf_destroy(buf);
+	net_buf_unref(parent);
+}
+
+struct net_buf *bt_buf_view_alloc(struct net_buf_pool *pool,
+				  struct net_buf *parent, size_t len,
+				  k_timeout_t timeout)
+{
+	struct net_buf *view;
+
+	view = net_buf_alloc_with_data(pool, parent->data, len, timeout);
+	if (view) {
+		*(struct net_buf **)view->user_data = net_buf_ref(parent);
+	}
+
+	return view;
+}
+
 struct net_buf *bt_buf_get_evt(uint8_t evt, bool discardable,
 			       k_timeout_t timeout)
 {
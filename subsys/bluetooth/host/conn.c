@@ -54,6 +54,10 @@ K_FIFO_DEFINE(free_tx);
 static void tx_complete_work(struct k_work *work);
 #endif /* CONFIG_BT_CONN_TX */
 
+#if defined(CONFIG_BT_CONN_TX_SCHED)
+static void tx_sched_queued(struct bt_conn *conn, int delta);
+#endif /* CONFIG_BT_CONN_TX_SCHED */
+
 /* Group Connected BT_CONN only in this */
 #if defined(CONFIG_BT_CONN)
 /* Peripheral timeout to initialize Connection Parameter Update procedure */
@@ -77,6 +81,11 @@ NET_BUF_POOL_DEFINE(acl_tx_pool, CONFIG_BT_L2CAP_TX_BUF_COUNT,
 NET_BUF_POOL_FIXED_DEFINE(frag_pool, CONFIG_BT_L2CAP_TX_FRAG_COUNT,
 			  BT_BUF_ACL_SIZE(CONFIG_BT_BUF_ACL_TX_SIZE), 8, NULL);
 
+#if defined(CONFIG_BT_L2CAP_TX_FRAG_VIEW)
+/* Views into the payload of a queued TX buffer */
+BT_BUF_VIEW_POOL_DEFINE(frag_view_pool, CONFIG_BT_L2CAP_TX_FRAG_COUNT);
+#endif /* CONFIG_BT_L2CAP_TX_FRAG_VIEW */
+
 #endif /* CONFIG_BT_L2CAP_TX_FRAG_COUNT > 0 */
 
 #if defined(CONFIG_BT_SMP) || defined(CONFIG_BT_BREDR)
@@ -166,39 +175,67 @@ static void tx_free(struct bt_conn_tx *tx)
 	k_fifo_put(&free_tx, tx);
 }
 
+/* Completed TX contexts handled per tx_notify() round */
+#define TX_NOTIFY_BATCH 8
+
 static void tx_notify(struct bt_conn *conn)
 {
+	struct {
+		bt_conn_tx_cb_t cb;
+		void *user_data;
+	} done[TX_NOTIFY_BATCH];
+
 	BT_DBG("conn %p", conn);
 
 	while (1) {
 		struct bt_conn_tx *tx;
+		sys_slist_t batch;
+		sys_snode_t *node;
 		unsigned int key;
-		bt_conn_tx_cb_t cb;
-		void *user_data;
+		size_t count = 0;
+
+		sys_slist_init(&batch);
 
 		key = irq_lock();
-		if (sys_slist_is_empty(&conn->tx_complete)) {
-			irq_unlock(key);
-			break;
+		while (count < ARRAY_SIZE(done) &&
+		       (node = sys_slist_get(&conn->tx_complete))) {
+			sys_slist_append(&batch, node);
+			count++;
 		}
-
-		tx = (void *)sys_slist_get_not_empty(&conn->tx_complete);
 		irq_unlock(key);
 
-		BT_DBG("tx %p cb %p user_data %p", tx, tx->cb, tx->user_data);
+		if (!count) {
+			break;
+		}
 
 		/* Copy over the params */
-		cb = tx->cb;
-		user_data = tx->user_data;
+		count = 0;
+		SYS_SLIST_FOR_EACH_CONTAINER(&batch, tx, node) {
+			BT_DBG("tx %p cb %p user_data %p", tx, tx->cb,
+			       tx->user_data);
 
-		/* Free up TX notify since there may be user waiting */
-		tx_free(tx);
+			done[count].cb = tx->cb;
+			done[count].user_data = tx->user_data;
+			count++;
+
+			tx->cb = NULL;
+			tx->user_data = NULL;
+			tx->pending_no_cb = 0U;
+		}
 
-		/* Run the callback, at this point it should be safe to
+		/* Free up the TX contexts at once since there may be users
+		 * waiting.
+		 */
+		k_fifo_put_list(&free_tx, sys_slist_peek_head(&batch),
+				sys_slist_peek_tail(&batch));
+
+		/* Run the callbacks, at this point it should be safe to
 		 * allocate new buffers since the TX should have been
-		 * unblocked by tx_free.
+		 * unblocked by freeing the contexts.
 		 */
-		cb(conn, user_data);
+		for (size_t i = 0; i < count; i++) {
+			done[i].cb(conn, done[i].user_data);
+		}
 	}
 }
 
@@ -220,6 +257,10 @@ struct bt_conn *bt_conn_new(struct bt_conn *conns, size_t size)
 
 	(void)memset(conn, 0, offsetof(struct bt_conn, ref));
 
+#if defined(CONFIG_BT_CONN_TX_SCHED)
+	conn->tx_sched.prio = BT_CONN_TX_PRIO_DEFAULT;
+#endif /* CONFIG_BT_CONN_TX_SCHED */
+
 #if defined(CONFIG_BT_CONN)
 	k_work_init_delayable(&conn->deferred_work, deferred_work);
 #endif /* CONFIG_BT_CONN */
@@ -409,6 +450,10 @@ int bt_conn_send_cb(struct bt_conn *conn, struct net_buf *buf,
 		tx_data(buf)->tx = NULL;
 	}
 
+#if defined(CONFIG_BT_CONN_TX_SCHED)
+	tx_sched_queued(conn, 1);
+#endif /* CONFIG_BT_CONN_TX_SCHED */
+
 	net_buf_put(&conn->tx_queue, buf);
 	return 0;
 }
@@ -439,7 +484,7 @@ static int send_acl(struct bt_conn *conn, struct net_buf *buf, uint8_t flags)
 
 	hdr = net_buf_push(buf, sizeof(*hdr));
 	hdr->handle = sys_cpu_to_le16(bt_acl_handle_pack(conn->handle, flags));
-	hdr->len = sys_cpu_to_le16(buf->len - sizeof(*hdr));
+	hdr->len = sys_cpu_to_le16(net_buf_frags_len(buf) - sizeof(*hdr));
 
 	bt_buf_set_type(buf, BT_BUF_ACL_OUT);
 
@@ -477,6 +522,106 @@ static int send_iso(struct bt_conn *conn, struct net_buf *buf, uint8_t flags)
 	return bt_send(buf);
 }
 
+#if defined(CONFIG_BT_CONN_TX_SCHED)
+static void tx_sched_queued(struct bt_conn *conn, int delta)
+{
+	struct bt_conn_tx_sched *sched = &conn->tx_sched;
+	int64_t now = k_uptime_ticks();
+	unsigned int key;
+
+	key = irq_lock();
+
+	/* Every queued buffer adds one tick of delay per tick, so the
+	 * integral of the queue length divided by the number of dequeued
+	 * buffers is their mean queueing delay.
+	 */
+	sched->delay_sum += (uint64_t)sched->queued * (now - sched->stamp);
+	sched->stamp = now;
+
+	if (delta > 0) {
+		sched->queued++;
+		sched->queued_max = MAX(sched->queued_max, sched->queued);
+	} else {
+		sched->queued--;
+		sched->dequeued++;
+	}
+
+	irq_unlock(key);
+}
+
+static void tx_sched_take(struct bt_conn *conn)
+{
+	unsigned int key;
+
+	key = irq_lock();
+	conn->tx_sched.inflight++;
+	irq_unlock(key);
+}
+
+/* Put the rest of a partially sent SDU back at the head of the queue,
+ * fragments included, so that it is the next buffer to be dequeued.
+ */
+static void tx_sched_requeue(struct bt_conn *conn, struct net_buf *buf)
+{
+	struct net_buf *prev = NULL;
+
+	conn->tx_sched.cont = buf;
+
+	while (buf) {
+		struct net_buf *next = buf->frags;
+
+		if (next) {
+			buf->flags |= NET_BUF_FRAGS;
+		}
+
+		k_queue_insert(&conn->tx_queue._queue, prev, buf);
+		prev = buf;
+		buf = next;
+	}
+}
+
+/* Stop in the middle of an SDU once the connection holds its full share
+ * of controller buffers, to continue with it when packets complete.
+ */
+static bool tx_sched_defer(struct bt_conn *conn, struct net_buf *buf)
+{
+	struct bt_conn_tx_sched *sched = &conn->tx_sched;
+	unsigned int key;
+	bool defer;
+
+	key = irq_lock();
+
+	defer = sched->quota && sched->inflight >= sched->quota;
+	if (defer) {
+		sched->throttled = true;
+		sched->throttles++;
+	}
+
+	irq_unlock(key);
+
+	if (defer) {
+		tx_sched_requeue(conn, buf);
+	}
+
+	return defer;
+}
+
+/* Whether buf is the remainder of an SDU whose start was already sent */
+static bool tx_sched_resume(struct bt_conn *conn, struct net_buf *buf)
+{
+	if (conn->tx_sched.cont != buf) {
+		return false;
+	}
+
+	conn->tx_sched.cont = NULL;
+
+	return true;
+}
+#else
+#define tx_sched_defer(conn, buf) false
+#define tx_sched_resume(conn, buf) false
+#endif /* CONFIG_BT_CONN_TX_SCHED */
+
 static bool send_frag(struct bt_conn *conn, struct net_buf *buf, uint8_t flags,
 		      bool always_consume)
 {
@@ -491,6 +636,10 @@ static bool send_frag(struct bt_conn *conn, struct net_buf *buf, uint8_t flags,
 	/* Wait until the controller can accept ACL packets */
 	k_sem_take(bt_conn_get_pkts(conn), K_FOREVER);
 
+#if defined(CONFIG_BT_CONN_TX_SCHED)
+	tx_sched_take(conn);
+#endif /* CONFIG_BT_CONN_TX_SCHED */
+
 	/* Check for disconnection while waiting for pkts_sem */
 	if (conn->state != BT_CONN_CONNECTED) {
 		goto fail;
@@ -539,7 +688,7 @@ static bool send_frag(struct bt_conn *conn, struct net_buf *buf, uint8_t flags,
 	return true;
 
 fail:
-	k_sem_give(bt_conn_get_pkts(conn));
+	bt_conn_pkts_give(conn, 1U);
 	if (tx) {
 		tx_free(tx);
 	}
@@ -598,6 +747,20 @@ static struct net_buf *create_frag(struct bt_conn *conn, struct net_buf *buf)
 	tx_data(frag)->tx = NULL;
 
 	frag_len = MIN(conn_mtu(conn), net_buf_tailroom(frag));
+	frag_len = MIN(frag_len, buf->len);
+
+#if defined(CONFIG_BT_L2CAP_TX_FRAG_VIEW)
+	if (conn->type != BT_CONN_TYPE_ISO) {
+		struct net_buf *view;
+
+		view = bt_buf_view_alloc(&frag_view_pool, buf, frag_len,
+					 K_FOREVER);
+		net_buf_frag_add(frag, view);
+		net_buf_pull(buf, frag_len);
+
+		return frag;
+	}
+#endif /* CONFIG_BT_L2CAP_TX_FRAG_VIEW */
 
 	net_buf_add_mem(frag, buf->data, frag_len);
 	net_buf_pull(buf, frag_len);
@@ -605,25 +768,40 @@ static struct net_buf *create_frag(struct bt_conn *conn, struct net_buf *buf)
 	return frag;
 }
 
+bool bt_conn_acl_single_pkt(struct bt_conn *conn, size_t len)
+{
+	return conn->type == BT_CONN_TYPE_LE && bt_dev.le.acl_mtu &&
+	       sizeof(struct bt_l2cap_hdr) + len <= bt_dev.le.acl_mtu;
+}
+
+static inline bool frag_is_view(struct bt_conn *conn)
+{
+	return IS_ENABLED(CONFIG_BT_L2CAP_TX_FRAG_VIEW) &&
+	       conn->type != BT_CONN_TYPE_ISO;
+}
+
 static bool send_buf(struct bt_conn *conn, struct net_buf *buf)
 {
 	struct net_buf *frag;
 
 	BT_DBG("conn %p buf %p len %u", conn, buf, buf->len);
 
-	/* Send directly if the packet fits the ACL MTU */
-	if (buf->len <= conn_mtu(conn)) {
-		return send_frag(conn, buf, FRAG_SINGLE, false);
-	}
+	/* A deferred SDU continues where it stopped */
+	if (!tx_sched_resume(conn, buf)) {
+		/* Send directly if the packet fits the ACL MTU */
+		if (buf->len <= conn_mtu(conn)) {
+			return send_frag(conn, buf, FRAG_SINGLE, false);
+		}
 
-	/* Create & enqueue first fragment */
-	frag = create_frag(conn, buf);
-	if (!frag) {
-		return false;
-	}
+		/* Create & enqueue first fragment */
+		frag = create_frag(conn, buf);
+		if (!frag) {
+			return false;
+		}
 
-	if (!send_frag(conn, frag, FRAG_START, true)) {
-		return false;
+		if (!send_frag(conn, frag, FRAG_START, true)) {
+			return false;
+		}
 	}
 
 	/*
@@ -631,6 +809,10 @@ static bool send_buf(struct bt_conn *conn, struct net_buf *buf)
 	 * buffer (which works since we've used net_buf_pull on it.
 	 */
 	while (buf->len > conn_mtu(conn)) {
+		if (tx_sched_defer(conn, buf)) {
+			return true;
+		}
+
 		frag = create_frag(conn, buf);
 		if (!frag) {
 			return false;
@@ -641,18 +823,136 @@ static bool send_buf(struct bt_conn *conn, struct net_buf *buf)
 		}
 	}
 
+	if (tx_sched_defer(conn, buf)) {
+		return true;
+	}
+
+	/* Earlier views still point right in front of the remaining data,
+	 * so the ACL header can't be pushed into the original buffer.
+	 */
+	if (frag_is_view(conn)) {
+		frag = create_frag(conn, buf);
+		if (!frag) {
+			return false;
+		}
+
+		tx_data(frag)->tx = tx_data(buf)->tx;
+		tx_data(buf)->tx = NULL;
+
+		if (!send_frag(conn, frag, FRAG_END, true)) {
+			return false;
+		}
+
+		net_buf_unref(buf);
+		return true;
+	}
+
 	return send_frag(conn, buf, FRAG_END, false);
 }
 
 static struct k_poll_signal conn_change =
 		K_POLL_SIGNAL_INITIALIZER(conn_change);
 
+void bt_conn_pkts_give(struct bt_conn *conn, uint16_t count)
+{
+	struct k_sem *pkts = bt_conn_get_pkts(conn);
+#if defined(CONFIG_BT_CONN_TX_SCHED)
+	struct bt_conn_tx_sched *sched = &conn->tx_sched;
+	bool resume = false;
+	unsigned int key;
+
+	key = irq_lock();
+
+	sched->inflight -= MIN(sched->inflight, count);
+
+	if (sched->throttled && sched->inflight < sched->quota) {
+		sched->throttled = false;
+		resume = true;
+	}
+
+	irq_unlock(key);
+
+	/* Have the TX thread poll the connection's queue again */
+	if (resume) {
+		k_poll_signal_raise(&conn_change, 0);
+	}
+#endif /* CONFIG_BT_CONN_TX_SCHED */
+
+	while (count--) {
+		k_sem_give(pkts);
+	}
+}
+
+#if defined(CONFIG_BT_CONN_TX)
+void bt_conn_tx_completed(struct bt_conn *conn, uint16_t count)
+{
+	sys_slist_t done;
+	uint16_t pkts = 0U;
+	unsigned int key;
+	bool notify;
+
+	sys_slist_init(&done);
+
+	/* Account for the whole count in one go, the packets without a
+	 * callback that follow each completed context included.
+	 */
+	key = irq_lock();
+
+	while (pkts < count) {
+		struct bt_conn_tx *tx;
+		sys_snode_t *node;
+
+		if (conn->pending_no_cb) {
+			uint32_t no_cb = MIN(conn->pending_no_cb, count - pkts);
+
+			conn->pending_no_cb -= no_cb;
+			pkts += no_cb;
+			continue;
+		}
+
+		node = sys_slist_get(&conn->tx_pending);
+		if (!node) {
+			break;
+		}
+
+		tx = CONTAINER_OF(node, struct bt_conn_tx, node);
+		conn->pending_no_cb = tx->pending_no_cb;
+		tx->pending_no_cb = 0U;
+		sys_slist_append(&done, node);
+		pkts++;
+	}
+
+	notify = !sys_slist_is_empty(&done);
+	if (notify) {
+		sys_slist_merge_slist(&conn->tx_complete, &done);
+	}
+
+	irq_unlock(key);
+
+	if (pkts < count) {
+		BT_ERR("packets count mismatch");
+	}
+
+	if (notify) {
+		k_work_submit(&conn->tx_complete_work);
+	}
+
+	bt_conn_pkts_give(conn, pkts);
+}
+#endif /* CONFIG_BT_CONN_TX */
+
 static void conn_cleanup(struct bt_conn *conn)
 {
 	struct net_buf *buf;
 
 	/* Give back any allocated buffers */
 	while ((buf = net_buf_get(&conn->tx_queue, K_NO_WAIT))) {
+#if defined(CONFIG_BT_CONN_TX_SCHED)
+		if (!tx_sched_resume(conn, buf)) {
+			tx_sched_queued(conn, -1);
+		}
+#endif /* CONFIG_BT_CONN_TX_SCHED */
+
 		if (tx_data(buf)->tx) {
 			tx_free(tx_data(buf)->tx);
 		}
@@ -696,6 +996,67 @@ static int conn_prepare_events(struct bt_conn *conn,
 	return 0;
 }
 
+#if defined(CONFIG_BT_CONN_TX_SCHED)
+static const uint8_t tx_sched_prios[] = {
+	BT_CONN_TX_PRIO_LATENCY,
+	BT_CONN_TX_PRIO_DEFAULT,
+	BT_CONN_TX_PRIO_BULK,
+};
+
+static inline bool tx_sched_backlogged(struct bt_conn *conn)
+{
+	return conn->state == BT_CONN_CONNECTED &&
+	       !k_fifo_is_empty(&conn->tx_queue);
+}
+
+/* Share the controller buffers of each pool between the connections that
+ * have data queued, in proportion to their priority, and hold back the
+ * connections that already use up their share.
+ */
+static void tx_sched_update(void)
+{
+	uint32_t weights[2] = { 0 };
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(acl_conns); i++) {
+		struct bt_conn *conn = &acl_conns[i];
+
+		if (tx_sched_backlogged(conn)) {
+			weights[bt_conn_get_pkts(conn) != &bt_dev.le.acl_pkts] +=
+				conn->tx_sched.prio;
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(acl_conns); i++) {
+		struct bt_conn *conn = &acl_conns[i];
+		struct bt_conn_tx_sched *sched = &conn->tx_sched;
+		struct k_sem *pkts;
+		unsigned int key;
+		uint32_t total;
+
+		if (!tx_sched_backlogged(conn)) {
+			sched->throttled = false;
+			continue;
+		}
+
+		pkts = bt_conn_get_pkts(conn);
+		total = weights[pkts != &bt_dev.le.acl_pkts];
+
+		key = irq_lock();
+
+		sched->quota = MAX(1U, pkts->limit * sched->prio / total);
+		if (sched->inflight < sched->quota) {
+			sched->throttled = false;
+		} else if (!sched->throttled) {
+			sched->throttled = true;
+			sched->throttles++;
+		}
+
+		irq_unlock(key);
+	}
+}
+#endif /* CONFIG_BT_CONN_TX_SCHED */
+
 int bt_conn_prepare_events(struct k_poll_event events[])
 {
 	int i, ev_count = 0;
@@ -707,7 +1068,27 @@ int bt_conn_prepare_events(struct k_poll_event events[])
 	k_poll_event_init(&events[ev_count++], K_POLL_TYPE_SIGNAL,
 			  K_POLL_MODE_NOTIFY_ONLY, &conn_change);
 
-#if defined(CONFIG_BT_CONN)
+#if defined(CONFIG_BT_CONN_TX_SCHED)
+	tx_sched_update();
+
+	/* Ready queues are served in event order, so add the connections
+	 * by decreasing priority.
+	 */
+	for (int p = 0; p < ARRAY_SIZE(tx_sched_prios); p++) {
+		for (i = 0; i < ARRAY_SIZE(acl_conns); i++) {
+			conn = &acl_conns[i];
+
+			if (conn->tx_sched.prio != tx_sched_prios[p] ||
+			    conn->tx_sched.throttled) {
+				continue;
+			}
+
+			if (!conn_prepare_events(conn, &events[ev_count])) {
+				ev_count++;
+			}
+		}
+	}
+#elif defined(CONFIG_BT_CONN)
 	for (i = 0; i < ARRAY_SIZE(acl_conns); i++) {
 		conn = &acl_conns[i];
 
@@ -715,7 +1096,7 @@ int bt_conn_prepare_events(struct k_poll_event events[])
 			ev_count++;
 		}
 	}
-#endif /* CONFIG_BT_CONN */
+#endif /* CONFIG_BT_CONN_TX_SCHED */
 
 #if defined(CONFIG_BT_ISO)
 	for (i = 0; i < ARRAY_SIZE(iso_conns); i++) {
@@ -746,6 +1127,14 @@ void bt_conn_process_tx(struct bt_conn *conn)
 	/* Get next ACL packet for connection */
 	buf = net_buf_get(&conn->tx_queue, K_NO_WAIT);
 	BT_ASSERT(buf);
+
+#if defined(CONFIG_BT_CONN_TX_SCHED)
+	/* A requeued remainder was already counted out */
+	if (conn->tx_sched.cont != buf) {
+		tx_sched_queued(conn, -1);
+	}
+#endif /* CONFIG_BT_CONN_TX_SCHED */
+
 	if (!send_buf(conn, buf)) {
 		net_buf_unref(buf);
 	}
@@ -764,7 +1153,7 @@ static void process_unack_tx(struct bt_conn *conn)
 		if (conn->pending_no_cb) {
 			conn->pending_no_cb--;
 			irq_unlock(key);
-			k_sem_give(bt_conn_get_pkts(conn));
+			bt_conn_pkts_give(conn, 1U);
 			continue;
 		}
 
@@ -784,29 +1173,37 @@ static void process_unack_tx(struct bt_conn *conn)
 
 		tx_free(tx);
 
-		k_sem_give(bt_conn_get_pkts(conn));
+		bt_conn_pkts_give(conn, 1U);
 	}
 }
 
+static inline bool conn_has_handle(struct bt_conn *conn, uint16_t handle)
+{
+	/* We only care about connections with a valid handle */
+	return conn->handle == handle && bt_conn_is_handle_valid(conn);
+}
+
 struct bt_conn *conn_lookup_handle(struct bt_conn *conns, size_t size,
 				   uint16_t handle)
 {
 	int i;
 
 	for (i = 0; i < size; i++) {
-		struct bt_conn *conn = bt_conn_ref(&conns[i]);
+		struct bt_conn *conn;
 
-		if (!conn) {
+		/* Only take a reference on a likely match, and check again
+		 * once it is held.
+		 */
+		if (!conn_has_handle(&conns[i], handle)) {
 			continue;
 		}
 
-		/* We only care about connections with a valid handle */
-		if (!bt_conn_is_handle_valid(conn)) {
-			bt_conn_unref(conn);
+		conn = bt_conn_ref(&conns[i]);
+		if (!conn) {
 			continue;
 		}
 
-		if (conn->handle != handle) {
+		if (!conn_has_handle(conn, handle)) {
 			bt_conn_unref(conn);
 			continue;
 		}
@@ -817,9 +1214,169 @@ struct bt_conn *conn_lookup_handle(struct bt_conn *conns, size_t size,
 	return NULL;
 }
 
+#if defined(CONFIG_BT_CONN)
+/* ACL connections are hashed by handle while the handle is valid, and LE
+ * connections by peer address from leaving until re-entering the
+ * disconnected state. Both are protected by irq_lock().
+ */
+#define CONN_HASH_SIZE (2 * CONFIG_BT_MAX_CONN + 1)
+
+static struct bt_conn *handle_hash[CONN_HASH_SIZE];
+static struct bt_conn *addr_hash[CONN_HASH_SIZE];
+
+static inline bool conn_is_acl(const struct bt_conn *conn)
+{
+	return conn >= acl_conns && conn < &acl_conns[ARRAY_SIZE(acl_conns)];
+}
+
+static inline struct bt_conn **handle_bucket(uint16_t handle)
+{
+	return &handle_hash[handle % CONN_HASH_SIZE];
+}
+
+static struct bt_conn **addr_bucket(const bt_addr_le_t *addr)
+{
+	uint32_t hash = addr->type;
+
+	for (int i = 0; i < ARRAY_SIZE(addr->a.val); i++) {
+		hash = hash * 31U + addr->a.val[i];
+	}
+
+	return &addr_hash[hash % CONN_HASH_SIZE];
+}
+
+static void handle_hash_add(struct bt_conn *conn)
+{
+	struct bt_conn **bucket = handle_bucket(conn->handle);
+	unsigned int key;
+
+	key = irq_lock();
+	conn->handle_next = *bucket;
+	*bucket = conn;
+	irq_unlock(key);
+}
+
+static void handle_hash_del(struct bt_conn *conn)
+{
+	struct bt_conn **prev = handle_bucket(conn->handle);
+	unsigned int key;
+
+	key = irq_lock();
+
+	for (; *prev; prev = &(*prev)->handle_next) {
+		if (*prev == conn) {
+			*prev = conn->handle_next;
+			break;
+		}
+	}
+
+	irq_unlock(key);
+}
+
+static void addr_hash_add(struct bt_conn *conn)
+{
+	struct bt_conn **bucket = addr_bucket(&conn->le.dst);
+	unsigned int key;
+
+	key = irq_lock();
+	conn->addr_next = *bucket;
+	*bucket = conn;
+	irq_unlock(key);
+}
+
+static bool addr_hash_del(struct bt_conn *conn)
+{
+	struct bt_conn **prev = addr_bucket(&conn->le.dst);
+	unsigned int key;
+	bool found = false;
+
+	key = irq_lock();
+
+	for (; *prev; prev = &(*prev)->addr_next) {
+		if (*prev == conn) {
+			*prev = conn->addr_next;
+			found = true;
+			break;
+		}
+	}
+
+	irq_unlock(key);
+
+	return found;
+}
+
+static struct bt_conn *acl_lookup_handle(uint16_t handle)
+{
+	struct bt_conn *conn;
+	unsigned int key;
+
+	key = irq_lock();
+
+	for (conn = *handle_bucket(handle); conn; conn = conn->handle_next) {
+		if (conn->handle == handle) {
+			break;
+		}
+	}
+
+	irq_unlock(key);
+
+	if (!conn) {
+		return NULL;
+	}
+
+	conn = bt_conn_ref(conn);
+	if (conn && !conn_has_handle(conn, handle)) {
+		bt_conn_unref(conn);
+		conn = NULL;
+	}
+
+	return conn;
+}
+
+void bt_conn_set_dst_le(struct bt_conn *conn, const bt_addr_le_t *dst)
+{
+	bool hashed = addr_hash_del(conn);
+
+	bt_addr_le_copy(&conn->le.dst, dst);
+
+	if (hashed) {
+		addr_hash_add(conn);
+	}
+}
+
+static void conn_hash_update(struct bt_conn *conn, bt_conn_state_t old_state,
+			     bool had_handle)
+{
+	bool has_handle = bt_conn_is_handle_valid(conn);
+
+	if (!conn_is_acl(conn)) {
+		return;
+	}
+
+	if (!had_handle && has_handle) {
+		handle_hash_add(conn);
+	} else if (had_handle && !has_handle) {
+		handle_hash_del(conn);
+	}
+
+	if (conn->type != BT_CONN_TYPE_LE) {
+		return;
+	}
+
+	if (old_state == BT_CONN_DISCONNECTED) {
+		addr_hash_add(conn);
+	} else if (conn->state == BT_CONN_DISCONNECTED) {
+		addr_hash_del(conn);
+	}
+}
+#endif /* CONFIG_BT_CONN */
+
 void bt_conn_set_state(struct bt_conn *conn, bt_conn_state_t state)
 {
 	bt_conn_state_t old_state;
+#if defined(CONFIG_BT_CONN)
+	bool had_handle;
+#endif /* CONFIG_BT_CONN */
 
 	BT_DBG("%s -> %s", state2str(conn->state), state2str(state));
 
@@ -829,8 +1386,15 @@ void bt_conn_set_state(struct bt_conn *conn, bt_conn_state_t state)
 	}
 
 	old_state = conn->state;
+#if defined(CONFIG_BT_CONN)
+	had_handle = bt_conn_is_handle_valid(conn);
+#endif /* CONFIG_BT_CONN */
 	conn->state = state;
 
+#if defined(CONFIG_BT_CONN)
+	conn_hash_update(conn, old_state, had_handle);
+#endif /* CONFIG_BT_CONN */
+
 	/* Actions needed for exiting the old state */
 	switch (old_state) {
 	case BT_CONN_DISCONNECTED:
@@ -997,7 +1561,7 @@ struct bt_conn *bt_conn_lookup_handle(uint16_t handle)
 	struct bt_conn *conn;
 
 #if defined(CONFIG_BT_CONN)
-	conn = conn_lookup_handle(acl_conns, ARRAY_SIZE(acl_conns), handle);
+	conn = acl_lookup_handle(handle);
 	if (conn) {
 		return conn;
 	}
@@ -2209,23 +2773,55 @@ bool bt_conn_is_peer_addr_le(const struct bt_conn *conn, uint8_t id,
 	return bt_addr_le_cmp(peer, &conn->le.init_addr) == 0;
 }
 
+static inline bool conn_is_peer_le(const struct bt_conn *conn, uint8_t id,
+				   const bt_addr_le_t *peer)
+{
+	return conn->type == BT_CONN_TYPE_LE &&
+	       bt_conn_is_peer_addr_le(conn, id, peer);
+}
+
 struct bt_conn *bt_conn_lookup_addr_le(uint8_t id, const bt_addr_le_t *peer)
 {
+	struct bt_conn *conn;
+	unsigned int key;
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(acl_conns); i++) {
-		struct bt_conn *conn = bt_conn_ref(&acl_conns[i]);
+	/* Connections are hashed by their current peer address; one known
+	 * by its initial address, or disconnected but still referenced, is
+	 * found by the scan below.
+	 */
+	key = irq_lock();
 
-		if (!conn) {
-			continue;
+	for (conn = *addr_bucket(peer); conn; conn = conn->addr_next) {
+		if (conn_is_peer_le(conn, id, peer)) {
+			break;
 		}
+	}
 
-		if (conn->type != BT_CONN_TYPE_LE) {
+	irq_unlock(key);
+
+	if (conn) {
+		conn = bt_conn_ref(conn);
+		if (conn && conn_is_peer_le(conn, id, peer)) {
+			return conn;
+		}
+
+		if (conn) {
 			bt_conn_unref(conn);
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(acl_conns); i++) {
+		if (!conn_is_peer_le(&acl_conns[i], id, peer)) {
+			continue;
+		}
+
+		conn = bt_conn_ref(&acl_conns[i]);
+		if (!conn) {
 			continue;
 		}
 
-		if (!bt_conn_is_peer_addr_le(conn, id, peer)) {
+		if (!conn_is_peer_le(conn, id, peer)) {
 			bt_conn_unref(conn);
 			continue;
 		}
@@ -2395,6 +2991,59 @@ int bt_conn_get_remote_info(struct bt_conn *conn,
 	}
 }
 
+int bt_conn_tx_prio_set(struct bt_conn *conn, enum bt_conn_tx_prio prio)
+{
+#if defined(CONFIG_BT_CONN_TX_SCHED)
+	switch (prio) {
+	case BT_CONN_TX_PRIO_BULK:
+	case BT_CONN_TX_PRIO_DEFAULT:
+	case BT_CONN_TX_PRIO_LATENCY:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	conn->tx_sched.prio = prio;
+	k_poll_signal_raise(&conn_change, 0);
+
+	return 0;
+#else
+	ARG_UNUSED(conn);
+	ARG_UNUSED(prio);
+
+	return -ENOTSUP;
+#endif /* CONFIG_BT_CONN_TX_SCHED */
+}
+
+int bt_conn_tx_stats_get(struct bt_conn *conn,
+			 struct bt_conn_tx_stats *stats)
+{
+#if defined(CONFIG_BT_CONN_TX_SCHED)
+	struct bt_conn_tx_sched sched;
+	unsigned int key;
+
+	key = irq_lock();
+	sched = conn->tx_sched;
+	irq_unlock(key);
+
+	stats->queued = sched.queued;
+	stats->queued_max = sched.queued_max;
+	stats->dequeued = sched.dequeued;
+	stats->delay_avg_us = sched.dequeued ?
+		k_ticks_to_us_floor64(sched.delay_sum / sched.dequeued) : 0U;
+	stats->throttles = sched.throttles;
+	stats->inflight = sched.inflight;
+	stats->quota = sched.quota;
+
+	return 0;
+#else
+	ARG_UNUSED(conn);
+	ARG_UNUSED(stats);
+
+	return -ENOTSUP;
+#endif /* CONFIG_BT_CONN_TX_SCHED */
+}
+
 /* Read Transmit Power Level HCI command */
 static int bt_conn_get_tx_power_level(struct bt_conn *conn, uint8_t type,
 				      int8_t *tx_power_level)
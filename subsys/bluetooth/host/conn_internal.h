@@ -198,6 +198,12 @@ struct bt_conn {
 	uint16_t rx_len;
 	struct net_buf		*rx;
 
+#if defined(CONFIG_BT_CONN)
+	/* Next ACL connection in the same handle and address hash bucket */
+	struct bt_conn		*handle_next;
+	struct bt_conn		*addr_next;
+#endif /* CONFIG_BT_CONN */
+
 	/* Sent but not acknowledged TX packets with a callback */
 	sys_slist_t		tx_pending;
 	/* Sent but not acknowledged TX packets without a callback before
@@ -214,6 +220,25 @@ struct bt_conn {
 	/* Queue for outgoing ACL data */
 	struct k_fifo		tx_queue;
 
+#if defined(CONFIG_BT_CONN_TX_SCHED)
+	struct bt_conn_tx_sched {
+		uint8_t			prio;
+		/* Held back at its quota, waiting for completed packets */
+		bool			throttled;
+		uint16_t		inflight;
+		uint16_t		quota;
+		uint32_t		queued;
+		uint32_t		queued_max;
+		uint32_t		dequeued;
+		uint32_t		throttles;
+		/* Integral of the queue length over time, in ticks */
+		uint64_t		delay_sum;
+		int64_t			stamp;
+		/* Remainder of an SDU stopped at the quota, requeued */
+		struct net_buf		*cont;
+	} tx_sched;
+#endif /* CONFIG_BT_CONN_TX_SCHED */
+
 	/* Active L2CAP channels */
 	sys_slist_t		channels;
 
@@ -268,6 +293,12 @@ static inline int bt_conn_send(struct bt_conn *conn, struct net_buf *buf)
 	return bt_conn_send_cb(conn, buf, NULL, NULL);
 }
 
+/* Give back controller buffers once packets of the connection are done */
+void bt_conn_pkts_give(struct bt_conn *conn, uint16_t count);
+
+/* Handle the packets the controller reported as completed for conn */
+void bt_conn_tx_completed(struct bt_conn *conn, uint16_t count);
+
 /* Check if a connection object with the peer already exists */
 bool bt_conn_exists_le(uint8_t id, const bt_addr_le_t *peer);
 
@@ -332,6 +363,9 @@ static inline bool bt_conn_is_handle_valid(struct bt_conn *conn)
 	}
 }
 
+/* Change the peer address of an LE connection */
+void bt_conn_set_dst_le(struct bt_conn *conn, const bt_addr_le_t *dst);
+
 /* Check if the connection is with the given peer. */
 bool bt_conn_is_peer_addr_le(const struct bt_conn *conn, uint8_t id,
 			     const bt_addr_le_t *peer);
@@ -424,6 +458,26 @@ struct net_buf *bt_conn_create_frag_timeout(size_t reserve,
 	bt_conn_create_frag_timeout(_reserve, K_FOREVER)
 #endif
 
+/* Check if an L2CAP PDU with len bytes of payload goes out as a single ACL
+ * packet. Only such a PDU may carry its payload in a fragment, since the
+ * ACL fragmentation works on the head buffer.
+ */
+bool bt_conn_acl_single_pkt(struct bt_conn *conn, size_t len);
+
+/* Data-less buffers pointing into the payload of another buffer, holding a
+ * reference to it in their user data.
+ */
+#define BT_BUF_VIEW_POOL_DEFINE(_name, _count) \
+	NET_BUF_POOL_FIXED_DEFINE(_name, _count, 0, sizeof(struct net_buf *), \
+				  bt_buf_view_destroy)
+
+void bt_buf_view_destroy(struct net_buf *buf);
+
+/* Allocate a view of len bytes at the start of the data of parent */
+struct net_buf *bt_buf_view_alloc(struct net_buf_pool *pool,
+				  struct net_buf *parent, size_t len,
+				  k_timeout_t timeout);
+
 /* Initialize connection management */
 int bt_conn_init(void);
 
@@ -771,10 +771,15 @@ static void db_hash_store(void)
 	BT_DBG("Database Hash stored");
 }
 
+#if defined(CONFIG_BT_GATT_CACHING_INCREMENTAL)
+static bool db_hash_gen_cached(struct gen_hash_state *state);
+#endif /* CONFIG_BT_GATT_CACHING_INCREMENTAL */
+
 static void db_hash_gen(bool store)
 {
 	uint8_t key[16] = {};
-	struct tc_aes_key_sched_struct sched;
+	/* Referenced by the CMAC states kept between calculations */
+	static struct tc_aes_key_sched_struct sched;
 	struct gen_hash_state state;
 
 	if (tc_cmac_setup(&state.state, key, &sched) == TC_CRYPTO_FAIL) {
@@ -782,7 +787,15 @@ static void db_hash_gen(bool store)
 		return;
 	}
 
+	state.err = 0;
+
+#if defined(CONFIG_BT_GATT_CACHING_INCREMENTAL)
+	if (!db_hash_gen_cached(&state)) {
+		bt_gatt_foreach_attr(0x0001, 0xffff, gen_hash_m, &state);
+	}
+#else
 	bt_gatt_foreach_attr(0x0001, 0xffff, gen_hash_m, &state);
+#endif /* CONFIG_BT_GATT_CACHING_INCREMENTAL */
 
 	if (tc_cmac_final(db_hash.hash, &state.state) == TC_CRYPTO_FAIL) {
 		BT_ERR("Unable to calculate hash");
@@ -1046,6 +1059,326 @@ BT_GATT_SERVICE_DEFINE(_1_gatt_svc,
 #endif /* CONFIG_BT_GATT_SERVICE_CHANGED */
 );
 
+#if defined(CONFIG_BT_GATT_INDEX)
+struct gatt_index_svc {
+	const struct bt_gatt_attr *attrs;
+	uint16_t attr_count;
+	uint16_t start_handle;
+	uint16_t end_handle;
+	/* Handles are stored in the attributes rather than implied by
+	 * their position.
+	 */
+	bool dynamic;
+};
+
+struct gatt_index_uuid {
+	uint16_t uuid;
+	uint16_t handle;
+};
+
+/* Services ordered by handle, and 16-bit UUID attributes ordered by UUID
+ * then handle. Either table is only used while valid, i.e. while the
+ * whole database fits.
+ */
+static struct {
+	bool valid;
+	uint8_t svc_count;
+	struct gatt_index_svc svcs[CONFIG_BT_GATT_INDEX_SVC_MAX];
+#if CONFIG_BT_GATT_INDEX_UUID_MAX > 0
+	bool uuid_valid;
+	uint16_t uuid_count;
+	struct gatt_index_uuid uuids[CONFIG_BT_GATT_INDEX_UUID_MAX];
+#endif /* CONFIG_BT_GATT_INDEX_UUID_MAX > 0 */
+} gatt_index;
+
+static inline uint16_t gatt_index_handle(const struct gatt_index_svc *svc,
+					 uint16_t i)
+{
+	return svc->dynamic ? svc->attrs[i].handle : svc->start_handle + i;
+}
+
+/* Position of the first attribute of svc with a handle >= handle */
+static uint16_t gatt_index_attr_lower(const struct gatt_index_svc *svc,
+				      uint16_t handle)
+{
+	uint16_t lo = 0U, hi = svc->attr_count;
+
+	if (!svc->dynamic) {
+		return handle > svc->start_handle ?
+		       MIN(handle - svc->start_handle, svc->attr_count) : 0U;
+	}
+
+	while (lo < hi) {
+		uint16_t mid = lo + (hi - lo) / 2U;
+
+		if (svc->attrs[mid].handle < handle) {
+			lo = mid + 1U;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/* Position of the first service ending at or after handle */
+static uint8_t gatt_index_svc_lower(uint16_t handle)
+{
+	uint8_t lo = 0U, hi = gatt_index.svc_count;
+
+	while (lo < hi) {
+		uint8_t mid = lo + (hi - lo) / 2U;
+
+		if (gatt_index.svcs[mid].end_handle < handle) {
+			lo = mid + 1U;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static const struct bt_gatt_attr *gatt_index_find(uint16_t handle)
+{
+	const struct gatt_index_svc *svc;
+	uint8_t i;
+	uint16_t j;
+
+	i = gatt_index_svc_lower(handle);
+	if (i == gatt_index.svc_count) {
+		return NULL;
+	}
+
+	svc = &gatt_index.svcs[i];
+	j = gatt_index_attr_lower(svc, handle);
+	if (j == svc->attr_count || gatt_index_handle(svc, j) != handle) {
+		return NULL;
+	}
+
+	return &svc->attrs[j];
+}
+
+static bool gatt_index_add(const struct bt_gatt_attr *attrs, size_t count,
+			   uint16_t start_handle, bool dynamic)
+{
+	struct gatt_index_svc *svc;
+
+	if (!count) {
+		return true;
+	}
+
+	if (gatt_index.svc_count == ARRAY_SIZE(gatt_index.svcs)) {
+		BT_WARN("GATT index full, falling back to database walk");
+		return false;
+	}
+
+	svc = &gatt_index.svcs[gatt_index.svc_count++];
+	svc->attrs = attrs;
+	svc->attr_count = count;
+	svc->start_handle = start_handle;
+	svc->dynamic = dynamic;
+	svc->end_handle = gatt_index_handle(svc, count - 1U);
+
+	return true;
+}
+
+#if CONFIG_BT_GATT_INDEX_UUID_MAX > 0
+/* Get the 16-bit form of uuid, if it has one */
+static bool gatt_index_uuid16(const struct bt_uuid *uuid, uint16_t *val)
+{
+	struct bt_uuid_16 u16 = BT_UUID_INIT_16(0);
+
+	switch (uuid->type) {
+	case BT_UUID_TYPE_16:
+		*val = BT_UUID_16(uuid)->val;
+		return true;
+	case BT_UUID_TYPE_32:
+		if (BT_UUID_32(uuid)->val > UINT16_MAX) {
+			return false;
+		}
+
+		u16.val = BT_UUID_32(uuid)->val;
+		break;
+	case BT_UUID_TYPE_128:
+		u16.val = sys_get_le16(&BT_UUID_128(uuid)->val[12]);
+		break;
+	default:
+		return false;
+	}
+
+	/* Longer forms only match when built on the Bluetooth Base UUID */
+	if (bt_uuid_cmp(&u16.uuid, uuid)) {
+		return false;
+	}
+
+	*val = u16.val;
+	return true;
+}
+
+static int gatt_index_uuid_cmp(const void *a, const void *b)
+{
+	const struct gatt_index_uuid *ua = a, *ub = b;
+
+	if (ua->uuid != ub->uuid) {
+		return ua->uuid < ub->uuid ? -1 : 1;
+	}
+
+	return (int)ua->handle - (int)ub->handle;
+}
+
+static void gatt_index_uuid_build(void)
+{
+	gatt_index.uuid_valid = false;
+	gatt_index.uuid_count = 0U;
+
+	for (uint8_t i = 0U; i < gatt_index.svc_count; i++) {
+		const struct gatt_index_svc *svc = &gatt_index.svcs[i];
+
+		for (uint16_t j = 0U; j < svc->attr_count; j++) {
+			struct gatt_index_uuid *entry;
+			uint16_t val;
+
+			if (!gatt_index_uuid16(svc->attrs[j].uuid, &val)) {
+				continue;
+			}
+
+			if (gatt_index.uuid_count ==
+			    ARRAY_SIZE(gatt_index.uuids)) {
+				BT_WARN("GATT UUID index full");
+				return;
+			}
+
+			entry = &gatt_index.uuids[gatt_index.uuid_count++];
+			entry->uuid = val;
+			entry->handle = gatt_index_handle(svc, j);
+		}
+	}
+
+	qsort(gatt_index.uuids, gatt_index.uuid_count,
+	      sizeof(gatt_index.uuids[0]), gatt_index_uuid_cmp);
+
+	gatt_index.uuid_valid = true;
+}
+#endif /* CONFIG_BT_GATT_INDEX_UUID_MAX > 0 */
+
+/* Called whenever the set of registered services changes */
+static void gatt_index_build(void)
+{
+	uint16_t handle = 1U;
+
+	gatt_index.valid = false;
+	gatt_index.svc_count = 0U;
+
+	STRUCT_SECTION_FOREACH(bt_gatt_service_static, static_svc) {
+		if (!gatt_index_add(static_svc->attrs, static_svc->attr_count,
+				    handle, false)) {
+			return;
+		}
+
+		handle += static_svc->attr_count;
+	}
+
+#if defined(CONFIG_BT_GATT_DYNAMIC_DB)
+	struct bt_gatt_service *svc;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&db, svc, node) {
+		if (!gatt_index_add(svc->attrs, svc->attr_count,
+				    svc->attrs[0].handle, true)) {
+			return;
+		}
+	}
+#endif /* CONFIG_BT_GATT_DYNAMIC_DB */
+
+	gatt_index.valid = true;
+
+#if CONFIG_BT_GATT_INDEX_UUID_MAX > 0
+	gatt_index_uuid_build();
+#endif /* CONFIG_BT_GATT_INDEX_UUID_MAX > 0 */
+}
+#endif /* CONFIG_BT_GATT_INDEX */
+
+#if defined(CONFIG_BT_GATT_CACHING_INCREMENTAL)
+/* CMAC state reached before each indexed service, and after the last one,
+ * as of the previous Database Hash calculation.
+ */
+static struct {
+	uint8_t count;
+	struct db_hash_svc {
+		const struct bt_gatt_attr *attrs;
+		uint16_t attr_count;
+		uint16_t start_handle;
+		/* Include declarations hash the handles of another service,
+		 * which may have moved.
+		 */
+		bool include;
+		struct tc_cmac_struct state;
+	} svcs[CONFIG_BT_GATT_INDEX_SVC_MAX + 1];
+} db_hash_cache;
+
+/* Continue the hash from the first service that changed since the last
+ * calculation. Returns false if the database is not indexed.
+ */
+static bool db_hash_gen_cached(struct gen_hash_state *state)
+{
+	uint8_t i, resume;
+
+	if (!gatt_index.valid) {
+		db_hash_cache.count = 0U;
+		return false;
+	}
+
+	for (resume = 0U; resume < MIN(db_hash_cache.count,
+				       gatt_index.svc_count); resume++) {
+		const struct gatt_index_svc *svc = &gatt_index.svcs[resume];
+		const struct db_hash_svc *cached = &db_hash_cache.svcs[resume];
+
+		if (cached->attrs != svc->attrs ||
+		    cached->attr_count != svc->attr_count ||
+		    cached->start_handle != svc->start_handle ||
+		    cached->include) {
+			break;
+		}
+	}
+
+	if (resume) {
+		state->state = db_hash_cache.svcs[resume].state;
+	}
+
+	BT_DBG("Hashing services %u to %u", resume, gatt_index.svc_count);
+
+	for (i = resume; i < gatt_index.svc_count; i++) {
+		const struct gatt_index_svc *svc = &gatt_index.svcs[i];
+		struct db_hash_svc *cached = &db_hash_cache.svcs[i];
+
+		cached->attrs = svc->attrs;
+		cached->attr_count = svc->attr_count;
+		cached->start_handle = svc->start_handle;
+		cached->include = false;
+		cached->state = state->state;
+
+		for (uint16_t j = 0U; j < svc->attr_count; j++) {
+			const struct bt_gatt_attr *attr = &svc->attrs[j];
+
+			if (!bt_uuid_cmp(attr->uuid, BT_UUID_GATT_INCLUDE)) {
+				cached->include = true;
+			}
+
+			if (gen_hash_m(attr, gatt_index_handle(svc, j),
+				       state) == BT_GATT_ITER_STOP) {
+				db_hash_cache.count = 0U;
+				return true;
+			}
+		}
+	}
+
+	db_hash_cache.svcs[i].state = state->state;
+	db_hash_cache.count = gatt_index.svc_count;
+
+	return true;
+}
+#endif /* CONFIG_BT_GATT_CACHING_INCREMENTAL */
+
 #if defined(CONFIG_BT_GATT_DYNAMIC_DB)
 static uint8_t found_attr(const struct bt_gatt_attr *attr, uint16_t handle,
 			  void *user_data)
@@ -1130,6 +1463,10 @@ populate:
 
 	gatt_insert(svc, last_handle);
 
+#if defined(CONFIG_BT_GATT_INDEX)
+	gatt_index_build();
+#endif /* CONFIG_BT_GATT_INDEX */
+
 	return 0;
 }
 #endif /* CONFIG_BT_GATT_DYNAMIC_DB */
@@ -1216,6 +1553,20 @@ static void clear_ccc_cfg(struct bt_gatt_ccc_cfg *cfg)
 	cfg->value = 0U;
 }
 
+#if defined(CONFIG_BT_GATT_NOTIFY_FANOUT)
+static void ccc_subscriber_set(struct _bt_gatt_ccc *ccc, struct bt_conn *conn,
+			       uint16_t value)
+{
+	/* Same match as notify_cb(): a peer that enabled both notifications
+	 * and indications is not notified.
+	 */
+	atomic_set_bit_to(ccc->_subscribers, bt_conn_index(conn),
+			  value == BT_GATT_CCC_NOTIFY);
+}
+#else
+#define ccc_subscriber_set(ccc, conn, value)
+#endif /* CONFIG_BT_GATT_NOTIFY_FANOUT */
+
 #if defined(CONFIG_BT_SETTINGS_CCC_STORE_ON_WRITE)
 static struct gatt_ccc_store {
 	struct bt_conn *conn_list[CONFIG_BT_MAX_CONN];
@@ -1293,6 +1644,10 @@ static void bt_gatt_service_init(void)
 	STRUCT_SECTION_FOREACH(bt_gatt_service_static, svc) {
 		last_static_handle += svc->attr_count;
 	}
+
+#if defined(CONFIG_BT_GATT_INDEX)
+	gatt_index_build();
+#endif /* CONFIG_BT_GATT_INDEX */
 }
 
 void bt_gatt_init(void)
@@ -1445,6 +1800,10 @@ static int gatt_unregister(struct bt_gatt_service *svc)
 		return -ENOENT;
 	}
 
+#if defined(CONFIG_BT_GATT_INDEX)
+	gatt_index_build();
+#endif /* CONFIG_BT_GATT_INDEX */
+
 	for (uint16_t i = 0; i < svc->attr_count; i++) {
 		struct bt_gatt_attr *attr = &svc->attrs[i];
 
@@ -1762,6 +2121,89 @@ static uint8_t gatt_foreach_iter(const struct bt_gatt_attr *attr,
 	return result;
 }
 
+#if defined(CONFIG_BT_GATT_INDEX)
+static bool foreach_attr_type_index(uint16_t start_handle, uint16_t end_handle,
+				    const struct bt_uuid *uuid,
+				    const void *attr_data, uint16_t num_matches,
+				    bt_gatt_attr_func_t func, void *user_data)
+{
+	if (!gatt_index.valid) {
+		return false;
+	}
+
+	for (uint8_t i = gatt_index_svc_lower(start_handle);
+	     i < gatt_index.svc_count; i++) {
+		const struct gatt_index_svc *svc = &gatt_index.svcs[i];
+
+		for (uint16_t j = gatt_index_attr_lower(svc, start_handle);
+		     j < svc->attr_count; j++) {
+			if (gatt_foreach_iter(&svc->attrs[j],
+					      gatt_index_handle(svc, j),
+					      start_handle, end_handle,
+					      uuid, attr_data, &num_matches,
+					      func, user_data) ==
+			    BT_GATT_ITER_STOP) {
+				return true;
+			}
+		}
+	}
+
+	return true;
+}
+
+#if CONFIG_BT_GATT_INDEX_UUID_MAX > 0
+static bool foreach_attr_type_uuid(uint16_t start_handle, uint16_t end_handle,
+				   const struct bt_uuid *uuid,
+				   const void *attr_data, uint16_t num_matches,
+				   bt_gatt_attr_func_t func, void *user_data)
+{
+	uint16_t lo = 0U, hi, val;
+
+	if (!gatt_index.valid || !gatt_index.uuid_valid || !uuid ||
+	    !gatt_index_uuid16(uuid, &val)) {
+		return false;
+	}
+
+	/* First entry for the UUID at or after start_handle */
+	hi = gatt_index.uuid_count;
+	while (lo < hi) {
+		const struct gatt_index_uuid *entry;
+		uint16_t mid = lo + (hi - lo) / 2U;
+
+		entry = &gatt_index.uuids[mid];
+		if (entry->uuid < val ||
+		    (entry->uuid == val && entry->handle < start_handle)) {
+			lo = mid + 1U;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for (; lo < gatt_index.uuid_count; lo++) {
+		uint16_t handle = gatt_index.uuids[lo].handle;
+		const struct bt_gatt_attr *attr;
+
+		if (gatt_index.uuids[lo].uuid != val) {
+			break;
+		}
+
+		attr = gatt_index_find(handle);
+		if (!attr) {
+			continue;
+		}
+
+		if (gatt_foreach_iter(attr, handle, start_handle, end_handle,
+				      uuid, attr_data, &num_matches, func,
+				      user_data) == BT_GATT_ITER_STOP) {
+			break;
+		}
+	}
+
+	return true;
+}
+#endif /* CONFIG_BT_GATT_INDEX_UUID_MAX > 0 */
+#endif /* CONFIG_BT_GATT_INDEX */
+
 static void foreach_attr_type_dyndb(uint16_t start_handle, uint16_t end_handle,
 				    const struct bt_uuid *uuid,
 				    const void *attr_data, uint16_t num_matches,
@@ -1810,6 +2252,20 @@ void bt_gatt_foreach_attr_type(uint16_t start_handle, uint16_t end_handle,
 		num_matches = UINT16_MAX;
 	}
 
+#if defined(CONFIG_BT_GATT_INDEX)
+#if CONFIG_BT_GATT_INDEX_UUID_MAX > 0
+	if (foreach_attr_type_uuid(start_handle, end_handle, uuid, attr_data,
+				   num_matches, func, user_data)) {
+		return;
+	}
+#endif /* CONFIG_BT_GATT_INDEX_UUID_MAX > 0 */
+
+	if (foreach_attr_type_index(start_handle, end_handle, uuid, attr_data,
+				    num_matches, func, user_data)) {
+		return;
+	}
+#endif /* CONFIG_BT_GATT_INDEX */
+
 	if (start_handle <= last_static_handle) {
 		uint16_t handle = 1;
 
@@ -1979,6 +2435,8 @@ ssize_t bt_gatt_attr_write_ccc(struct bt_conn *conn,
 	value_changed = cfg->value != value;
 	cfg->value = value;
 
+	ccc_subscriber_set(ccc, conn, value);
+
 	BT_DBG("handle 0x%04x value %u", attr->handle, cfg->value);
 
 	/* Update cfg if don't match */
@@ -2164,12 +2622,9 @@ static int gatt_notify_mult(struct bt_conn *conn, uint16_t handle,
 }
 #endif /* CONFIG_BT_GATT_NOTIFY_MULTIPLE */
 
-static int gatt_notify(struct bt_conn *conn, uint16_t handle,
-		       struct bt_gatt_notify_params *params)
+static int gatt_notify_check(struct bt_conn *conn,
+			     struct bt_gatt_notify_params *params)
 {
-	struct net_buf *buf;
-	struct bt_att_notify *nfy;
-
 #if defined(CONFIG_BT_GATT_ENFORCE_CHANGE_UNAWARE)
 	/* BLUETOOTH CORE SPECIFICATION Version 5.1 | Vol 3, Part G page 2350:
 	 * Except for the Handle Value indication, the  server shall not send
@@ -2188,6 +2643,21 @@ static int gatt_notify(struct bt_conn *conn, uint16_t handle,
 		return -EPERM;
 	}
 
+	return 0;
+}
+
+static int gatt_notify(struct bt_conn *conn, uint16_t handle,
+		       struct bt_gatt_notify_params *params)
+{
+	struct net_buf *buf;
+	struct bt_att_notify *nfy;
+	int err;
+
+	err = gatt_notify_check(conn, params);
+	if (err) {
+		return err;
+	}
+
 #if defined(CONFIG_BT_GATT_NOTIFY_MULTIPLE)
 	if (gatt_cf_notify_multi(conn)) {
 		return gatt_notify_mult(conn, handle, params);
@@ -2212,6 +2682,71 @@ static int gatt_notify(struct bt_conn *conn, uint16_t handle,
 	return bt_att_send(conn, buf, params->func, params->user_data);
 }
 
+#if defined(CONFIG_BT_GATT_NOTIFY_FANOUT)
+#define NFY_VALUE_MAX (CONFIG_BT_L2CAP_TX_MTU - sizeof(struct bt_att_hdr) - \
+		       sizeof(struct bt_att_notify))
+
+/* Notification values encoded once for all subscribers */
+NET_BUF_POOL_FIXED_DEFINE(nfy_value_pool, CONFIG_BT_GATT_NOTIFY_FANOUT_COUNT,
+			  NFY_VALUE_MAX, 0, NULL);
+
+/* Views into a shared value, one per subscriber PDU */
+BT_BUF_VIEW_POOL_DEFINE(nfy_view_pool,
+			CONFIG_BT_GATT_NOTIFY_FANOUT_COUNT * CONFIG_BT_MAX_CONN);
+
+static bool gatt_notify_shareable(struct bt_conn *conn, uint16_t len)
+{
+#if defined(CONFIG_BT_GATT_NOTIFY_MULTIPLE)
+	if (gatt_cf_notify_multi(conn)) {
+		return false;
+	}
+#endif /* CONFIG_BT_GATT_NOTIFY_MULTIPLE */
+
+	return bt_conn_acl_single_pkt(conn, sizeof(struct bt_att_hdr) +
+				      sizeof(struct bt_att_notify) + len);
+}
+
+static int gatt_notify_shared(struct bt_conn *conn, uint16_t handle,
+			      struct bt_gatt_notify_params *params,
+			      struct net_buf *value)
+{
+	struct net_buf *buf, *view;
+	struct bt_att_notify *nfy;
+	int err;
+
+	if (!value || !gatt_notify_shareable(conn, params->len)) {
+		return gatt_notify(conn, handle, params);
+	}
+
+	err = gatt_notify_check(conn, params);
+	if (err) {
+		return err;
+	}
+
+	view = bt_buf_view_alloc(&nfy_view_pool, value, value->len, K_NO_WAIT);
+	if (!view) {
+		return gatt_notify(conn, handle, params);
+	}
+
+	buf = bt_att_create_pdu(conn, BT_ATT_OP_NOTIFY,
+				sizeof(*nfy) + params->len);
+	if (!buf) {
+		BT_WARN("No buffer available to send notification");
+		net_buf_unref(view);
+		return -ENOMEM;
+	}
+
+	BT_DBG("conn %p handle 0x%04x shared %p", conn, handle, value);
+
+	nfy = net_buf_add(buf, sizeof(*nfy));
+	nfy->handle = sys_cpu_to_le16(handle);
+
+	net_buf_frag_add(buf, view);
+
+	return bt_att_send(conn, buf, params->func, params->user_data);
+}
+#endif /* CONFIG_BT_GATT_NOTIFY_FANOUT */
+
 static void gatt_indicate_rsp(struct bt_conn *conn, uint8_t err,
 			      const void *pdu, uint16_t length, void *user_data)
 {
@@ -2350,6 +2885,68 @@ static int gatt_indicate(struct bt_conn *conn, uint16_t handle,
 	return err;
 }
 
+#if defined(CONFIG_BT_GATT_NOTIFY_FANOUT)
+static uint8_t notify_fanout(const struct bt_gatt_attr *attr,
+			     struct _bt_gatt_ccc *ccc, struct notify_data *data)
+{
+	struct bt_gatt_notify_params *params = data->nfy_params;
+	struct net_buf *value = NULL;
+	int err = 0;
+	size_t i;
+
+	/* Encode the value once, subscribers reference it from their PDU */
+	if (params->len && params->len <= NFY_VALUE_MAX) {
+		value = net_buf_alloc(&nfy_value_pool, K_NO_WAIT);
+		if (value) {
+			net_buf_add_mem(value, params->data, params->len);
+		}
+	}
+
+	for (i = 0; i < CONFIG_BT_MAX_CONN; i++) {
+		struct bt_conn *conn;
+
+		if (!atomic_test_bit(ccc->_subscribers, i)) {
+			continue;
+		}
+
+		conn = bt_conn_lookup_index(i);
+		if (!conn) {
+			continue;
+		}
+
+		if (conn->state != BT_CONN_CONNECTED ||
+		    (ccc->cfg_match && !ccc->cfg_match(conn, attr))) {
+			bt_conn_unref(conn);
+			continue;
+		}
+
+		/* Confirm that the connection has the correct level of security */
+		if (bt_gatt_check_perm(conn, attr,
+				       BT_GATT_PERM_READ_ENCRYPT | BT_GATT_PERM_READ_AUTHEN)) {
+			BT_WARN("Link is not encrypted");
+			bt_conn_unref(conn);
+			continue;
+		}
+
+		err = gatt_notify_shared(conn, data->handle, params, value);
+
+		bt_conn_unref(conn);
+
+		if (err < 0) {
+			break;
+		}
+
+		data->err = 0;
+	}
+
+	if (value) {
+		net_buf_unref(value);
+	}
+
+	return err < 0 ? BT_GATT_ITER_STOP : BT_GATT_ITER_CONTINUE;
+}
+#endif /* CONFIG_BT_GATT_NOTIFY_FANOUT */
+
 static uint8_t notify_cb(const struct bt_gatt_attr *attr, uint16_t handle,
 			 void *user_data)
 {
@@ -2390,6 +2987,12 @@ static uint8_t notify_cb(const struct bt_gatt_attr *attr, uint16_t handle,
 		}
 	}
 
+#if defined(CONFIG_BT_GATT_NOTIFY_FANOUT)
+	if (data->type == BT_GATT_CCC_NOTIFY) {
+		return notify_fanout(attr, ccc, data);
+	}
+#endif /* CONFIG_BT_GATT_NOTIFY_FANOUT */
+
 	/* Notify all peers configured */
 	for (i = 0; i < ARRAY_SIZE(ccc->cfg); i++) {
 		struct bt_gatt_ccc_cfg *cfg = &ccc->cfg[i];
@@ -2770,6 +3373,9 @@ static uint8_t update_ccc(const struct bt_gatt_attr *attr, uint16_t handle,
 			continue;
 		}
 
+		/* Security is checked again for each notification */
+		ccc_subscriber_set(ccc, conn, cfg->value);
+
 		/* Check if attribute requires encryption/authentication */
 		err = bt_gatt_check_perm(conn, attr, BT_GATT_PERM_WRITE_MASK);
 		if (err) {
@@ -2824,6 +3430,8 @@ static uint8_t disconnected_cb(const struct bt_gatt_attr *attr, uint16_t handle,
 
 	ccc = attr->user_data;
 
+	ccc_subscriber_set(ccc, conn, 0U);
+
 	/* If already disabled skip */
 	if (!ccc->value) {
 		return BT_GATT_ITER_CONTINUE;
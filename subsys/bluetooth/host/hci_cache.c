@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2022 Xiaomi Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <settings/settings.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+
+#include "hci_core.h"
+
+#define BT_DBG_ENABLED IS_ENABLED(CONFIG_BT_DEBUG_HCI_CORE)
+#define LOG_MODULE_NAME bt_hci_cache
+#include "common/log.h"
+
+/* Controller capability reads whose return parameters never change for a
+ * given controller and firmware.
+ */
+static const struct {
+	uint16_t opcode;
+	uint8_t len;
+} cache_ops[] = {
+	{ BT_HCI_OP_READ_LOCAL_FEATURES,
+	  sizeof(struct bt_hci_rp_read_local_features) },
+	{ BT_HCI_OP_READ_SUPPORTED_COMMANDS,
+	  sizeof(struct bt_hci_rp_read_supported_commands) },
+	{ BT_HCI_OP_READ_BUFFER_SIZE,
+	  sizeof(struct bt_hci_rp_read_buffer_size) },
+	{ BT_HCI_OP_LE_READ_LOCAL_FEATURES,
+	  sizeof(struct bt_hci_rp_le_read_local_features) },
+	{ BT_HCI_OP_LE_READ_BUFFER_SIZE,
+	  sizeof(struct bt_hci_rp_le_read_buffer_size) },
+	{ BT_HCI_OP_LE_READ_BUFFER_SIZE_V2,
+	  sizeof(struct bt_hci_rp_le_read_buffer_size_v2) },
+	{ BT_HCI_OP_LE_READ_SUPP_STATES,
+	  sizeof(struct bt_hci_rp_le_read_supp_states) },
+	{ BT_HCI_OP_LE_READ_RL_SIZE,
+	  sizeof(struct bt_hci_rp_le_read_rl_size) },
+	{ BT_HCI_OP_LE_READ_MAX_DATA_LEN,
+	  sizeof(struct bt_hci_rp_le_read_max_data_len) },
+};
+
+#define CACHE_DATA_LEN (sizeof(struct bt_hci_rp_read_local_features) + \
+			sizeof(struct bt_hci_rp_read_supported_commands) + \
+			sizeof(struct bt_hci_rp_read_buffer_size) + \
+			sizeof(struct bt_hci_rp_le_read_local_features) + \
+			sizeof(struct bt_hci_rp_le_read_buffer_size) + \
+			sizeof(struct bt_hci_rp_le_read_buffer_size_v2) + \
+			sizeof(struct bt_hci_rp_le_read_supp_states) + \
+			sizeof(struct bt_hci_rp_le_read_rl_size) + \
+			sizeof(struct bt_hci_rp_le_read_max_data_len))
+
+/* Stored as a single "bt/hcic" settings entry */
+struct hci_cache {
+	/* Read Local Version Information return parameters */
+	struct bt_hci_rp_read_local_version_info fp;
+	/* Bit n set if cache_ops[n] is stored */
+	uint16_t valid;
+	uint8_t data[CACHE_DATA_LEN];
+} __packed;
+
+BUILD_ASSERT(ARRAY_SIZE(cache_ops) <= 16);
+
+static struct hci_cache cache;
+static bool active;
+static bool dirty;
+
+static int cache_find(uint16_t opcode, size_t *offset)
+{
+	size_t off = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(cache_ops); i++) {
+		if (cache_ops[i].opcode == opcode) {
+			*offset = off;
+			return i;
+		}
+
+		off += cache_ops[i].len;
+	}
+
+	return -ENOENT;
+}
+
+static int cache_load(const char *key, size_t len, settings_read_cb read_cb,
+		      void *cb_arg, void *param)
+{
+	struct hci_cache *stored = param;
+	ssize_t ret;
+
+	if (key || len != sizeof(*stored)) {
+		return 0;
+	}
+
+	ret = read_cb(cb_arg, stored, sizeof(*stored));
+	if (ret != sizeof(*stored)) {
+		stored->valid = 0U;
+	}
+
+	return 0;
+}
+
+void bt_hci_cache_init(struct net_buf *ver_rsp)
+{
+	struct hci_cache stored = { 0 };
+
+	if (ver_rsp->len != sizeof(cache.fp)) {
+		return;
+	}
+
+	settings_load_subtree_direct("bt/hcic", cache_load, &stored);
+
+	if (stored.valid && !memcmp(&stored.fp, ver_rsp->data,
+				    sizeof(stored.fp))) {
+		cache = stored;
+		dirty = false;
+		BT_DBG("Controller cache hit, valid 0x%04x", cache.valid);
+	} else {
+		memset(&cache, 0, sizeof(cache));
+		memcpy(&cache.fp, ver_rsp->data, sizeof(cache.fp));
+		dirty = true;
+		BT_DBG("Controller cache miss");
+	}
+
+	active = true;
+}
+
+bool bt_hci_cache_get(uint16_t opcode, struct net_buf *buf)
+{
+	size_t offset;
+	int i;
+
+	if (!active) {
+		return false;
+	}
+
+	i = cache_find(opcode, &offset);
+	if (i < 0 || !(cache.valid & BIT(i))) {
+		return false;
+	}
+
+	net_buf_reset(buf);
+	net_buf_add_mem(buf, &cache.data[offset], cache_ops[i].len);
+
+	return true;
+}
+
+void bt_hci_cache_put(uint16_t opcode, struct net_buf *rsp)
+{
+	size_t offset;
+	int i;
+
+	if (!active) {
+		return;
+	}
+
+	i = cache_find(opcode, &offset);
+	if (i < 0 || rsp->len != cache_ops[i].len || rsp->data[0]) {
+		return;
+	}
+
+	if ((cache.valid & BIT(i)) &&
+	    !memcmp(&cache.data[offset], rsp->data, rsp->len)) {
+		return;
+	}
+
+	memcpy(&cache.data[offset], rsp->data, rsp->len);
+	cache.valid |= BIT(i);
+	dirty = true;
+}
+
+static void cache_save(struct k_work *work)
+{
+	int err;
+
+	err = settings_save_one("bt/hcic", &cache, sizeof(cache));
+	if (err) {
+		BT_ERR("Failed to save controller cache (err %d)", err);
+	}
+}
+
+static K_WORK_DEFINE(cache_save_work, cache_save);
+
+void bt_hci_cache_commit(void)
+{
+	if (!active || !dirty) {
+		return;
+	}
+
+	dirty = false;
+	k_work_submit(&cache_save_work);
+}
@@ -76,14 +76,14 @@ static void init_work(struct k_work *work);
 
 struct bt_dev bt_dev = {
 	.init          = Z_WORK_INITIALIZER(init_work),
-	/* Give cmd_sem allowing to send first HCI_Reset cmd, the only
-	 * exception is if the controller requests to wait for an
-	 * initial Command Complete for NOP.
+	/* Start with one command credit allowing to send the first
+	 * HCI_Reset cmd, the only exception is if the controller requests
+	 * to wait for an initial Command Complete for NOP. ncmd_sem only
+	 * wakes the TX thread once credits are granted.
 	 */
-#if !defined(CONFIG_BT_WAIT_NOP)
-	.ncmd_sem      = Z_SEM_INITIALIZER(bt_dev.ncmd_sem, 1, 1),
-#else
 	.ncmd_sem      = Z_SEM_INITIALIZER(bt_dev.ncmd_sem, 0, 1),
+#if !defined(CONFIG_BT_WAIT_NOP)
+	.ncmd          = 1,
 #endif
 	.cmd_tx_queue  = Z_FIFO_INITIALIZER(bt_dev.cmd_tx_queue),
 #if defined(CONFIG_BT_DEVICE_APPEARANCE_DYNAMIC)
@@ -109,6 +109,9 @@ struct cmd_data {
 
 	/** Used by bt_hci_cmd_send_sync. */
 	struct k_sem *sync;
+
+	/** Signalled on completion, for bt_hci_cmd_send_sync_end. */
+	struct k_sem sync_sem;
 };
 
 static struct cmd_data cmd_data[CONFIG_BT_BUF_CMD_TX_COUNT];
@@ -284,13 +287,9 @@ int bt_hci_cmd_send(uint16_t opcode, struct net_buf *buf)
 	return 0;
 }
 
-int bt_hci_cmd_send_sync(uint16_t opcode, struct net_buf *buf,
-			 struct net_buf **rsp)
+int bt_hci_cmd_send_sync_begin(uint16_t opcode, struct net_buf *buf,
+			       struct net_buf **pending)
 {
-	struct k_sem sync_sem;
-	uint8_t status;
-	int err;
-
 	if (!buf) {
 		buf = bt_hci_cmd_create(opcode, 0);
 		if (!buf) {
@@ -300,12 +299,32 @@ int bt_hci_cmd_send_sync(uint16_t opcode, struct net_buf *buf,
 
 	BT_DBG("buf %p opcode 0x%04x len %u", buf, opcode, buf->len);
 
-	k_sem_init(&sync_sem, 0, 1);
-	cmd(buf)->sync = &sync_sem;
+	k_sem_init(&cmd(buf)->sync_sem, 0, 1);
+	cmd(buf)->sync = &cmd(buf)->sync_sem;
+
+#if defined(CONFIG_BT_HCI_CACHE)
+	if (bt_hci_cache_get(opcode, buf)) {
+		cmd(buf)->status = 0U;
+		k_sem_give(cmd(buf)->sync);
+		*pending = buf;
+		return 0;
+	}
+#endif /* CONFIG_BT_HCI_CACHE */
 
 	net_buf_put(&bt_dev.cmd_tx_queue, net_buf_ref(buf));
 
-	err = k_sem_take(&sync_sem, HCI_CMD_TIMEOUT);
+	*pending = buf;
+
+	return 0;
+}
+
+int bt_hci_cmd_send_sync_end(struct net_buf *buf, struct net_buf **rsp)
+{
+	uint16_t opcode = cmd(buf)->opcode;
+	uint8_t status;
+	int err;
+
+	err = k_sem_take(cmd(buf)->sync, HCI_CMD_TIMEOUT);
 	BT_ASSERT_MSG(err == 0, "k_sem_take failed with err %d", err);
 
 	status = cmd(buf)->status;
@@ -323,6 +342,10 @@ int bt_hci_cmd_send_sync(uint16_t opcode, struct net_buf *buf,
 
 	BT_DBG("rsp %p opcode 0x%04x len %u", buf, opcode, buf->len);
 
+#if defined(CONFIG_BT_HCI_CACHE)
+	bt_hci_cache_put(opcode, buf);
+#endif /* CONFIG_BT_HCI_CACHE */
+
 	if (rsp) {
 		*rsp = buf;
 	} else {
@@ -332,6 +355,33 @@ int bt_hci_cmd_send_sync(uint16_t opcode, struct net_buf *buf,
 	return 0;
 }
 
+int bt_hci_cmd_send_sync(uint16_t opcode, struct net_buf *buf,
+			 struct net_buf **rsp)
+{
+	int err;
+
+	err = bt_hci_cmd_send_sync_begin(opcode, buf, &buf);
+	if (err) {
+		return err;
+	}
+
+	return bt_hci_cmd_send_sync_end(buf, rsp);
+}
+
+int bt_hci_rx_stats_get(struct bt_hci_rx_stats *stats)
+{
+#if defined(CONFIG_BT_RECV_BATCH)
+	*stats = bt_dev.rx_stats;
+	stats->depth = atomic_get(&bt_dev.rx_depth);
+
+	return 0;
+#else
+	ARG_UNUSED(stats);
+
+	return -ENOTSUP;
+#endif
+}
+
 int bt_hci_le_rand(void *buffer, size_t len)
 {
 	struct bt_hci_rp_le_rand *rp;
@@ -421,40 +471,7 @@ static void hci_num_completed_packets(struct net_buf *buf)
 			continue;
 		}
 
-		while (count--) {
-			struct bt_conn_tx *tx;
-			sys_snode_t *node;
-			unsigned int key;
-
-			key = irq_lock();
-
-			if (conn->pending_no_cb) {
-				conn->pending_no_cb--;
-				irq_unlock(key);
-				k_sem_give(bt_conn_get_pkts(conn));
-				continue;
-			}
-
-			node = sys_slist_get(&conn->tx_pending);
-			irq_unlock(key);
-
-			if (!node) {
-				BT_ERR("packets count mismatch");
-				break;
-			}
-
-			tx = CONTAINER_OF(node, struct bt_conn_tx, node);
-
-			key = irq_lock();
-			conn->pending_no_cb = tx->pending_no_cb;
-			tx->pending_no_cb = 0U;
-			sys_slist_append(&conn->tx_complete, &tx->node);
-			irq_unlock(key);
-
-			k_work_submit(&conn->tx_complete_work);
-			k_sem_give(bt_conn_get_pkts(conn));
-		}
-
+		bt_conn_tx_completed(conn, count);
 		bt_conn_unref(conn);
 	}
 }
@@ -1239,7 +1256,7 @@ void bt_hci_le_enh_conn_complete(struct bt_hci_evt_le_enh_conn_complete *evt)
 	}
 
 	conn->handle = handle;
-	bt_addr_le_copy(&conn->le.dst, &id_addr);
+	bt_conn_set_dst_le(conn, &id_addr);
 	conn->le.interval = sys_le16_to_cpu(evt->interval);
 	conn->le.latency = sys_le16_to_cpu(evt->latency);
 	conn->le.timeout = sys_le16_to_cpu(evt->supv_timeout);
@@ -2023,28 +2040,62 @@ static void hci_reset_complete(struct net_buf *buf)
 	atomic_set(bt_dev.flags, flags);
 }
 
-static void hci_cmd_done(uint16_t opcode, uint8_t status, struct net_buf *buf)
+/* Track a command about to be sent, unless the controller has no room */
+static bool sent_cmd_add(struct net_buf *buf)
 {
-	BT_DBG("opcode 0x%04x status 0x%02x buf %p", opcode, status, buf);
+	unsigned int key;
+	bool added = false;
 
-	if (net_buf_pool_get(buf->pool_id) != &hci_cmd_pool) {
-		BT_WARN("opcode 0x%04x pool id %u pool %p != &hci_cmd_pool %p",
-			opcode, buf->pool_id, net_buf_pool_get(buf->pool_id),
-			&hci_cmd_pool);
-		return;
+	key = irq_lock();
+
+	if (bt_dev.ncmd &&
+	    bt_dev.sent_cmd_count < CONFIG_BT_HCI_CMD_PIPELINE) {
+		bt_dev.sent_cmd[bt_dev.sent_cmd_count++] = buf;
+		bt_dev.ncmd--;
+		added = true;
 	}
 
-	if (cmd(buf)->opcode != opcode) {
-		BT_WARN("OpCode 0x%04x completed instead of expected 0x%04x",
-			opcode, cmd(buf)->opcode);
-		return;
+	irq_unlock(key);
+
+	return added;
+}
+
+/* Remove the given command or, with match NULL, the oldest one with the
+ * opcode; commands with the same opcode complete in the order they were
+ * sent.
+ */
+static struct net_buf *sent_cmd_take(uint16_t opcode, struct net_buf *match)
+{
+	struct net_buf *buf = NULL;
+	unsigned int key;
+	uint8_t i;
+
+	key = irq_lock();
+
+	for (i = 0U; i < bt_dev.sent_cmd_count; i++) {
+		if (match ? bt_dev.sent_cmd[i] == match :
+		    cmd(bt_dev.sent_cmd[i])->opcode == opcode) {
+			buf = bt_dev.sent_cmd[i];
+			break;
+		}
 	}
 
-	if (bt_dev.sent_cmd) {
-		net_buf_unref(bt_dev.sent_cmd);
-		bt_dev.sent_cmd = NULL;
+	if (buf) {
+		bt_dev.sent_cmd_count--;
+		for (; i < bt_dev.sent_cmd_count; i++) {
+			bt_dev.sent_cmd[i] = bt_dev.sent_cmd[i + 1];
+		}
+		bt_dev.sent_cmd[i] = NULL;
 	}
 
+	irq_unlock(key);
+
+	return buf;
+}
+
+static void hci_cmd_finish(struct net_buf *buf, uint8_t status,
+			   struct net_buf *evt_buf)
+{
 	if (cmd(buf)->state && !status) {
 		struct bt_hci_cmd_state_set *update = cmd(buf)->state;
 
@@ -2054,8 +2105,83 @@ static void hci_cmd_done(uint16_t opcode, uint8_t status, struct net_buf *buf)
 	/* If the command was synchronous wake up bt_hci_cmd_send_sync() */
 	if (cmd(buf)->sync) {
 		cmd(buf)->status = status;
+
+		/* The response was received into its own buffer, hand the
+		 * return parameters over in the command buffer.
+		 */
+		if (evt_buf != buf) {
+			net_buf_reset(buf);
+			net_buf_add_mem(buf, evt_buf->data, evt_buf->len);
+		}
+
 		k_sem_give(cmd(buf)->sync);
 	}
+
+	net_buf_unref(buf);
+}
+
+/* Fail every command still awaiting a completion, returning how many */
+static uint8_t sent_cmd_flush(void)
+{
+	struct net_buf *flushed[CONFIG_BT_HCI_CMD_PIPELINE];
+	unsigned int key;
+	uint8_t count, i;
+
+	key = irq_lock();
+
+	count = bt_dev.sent_cmd_count;
+	for (i = 0U; i < count; i++) {
+		flushed[i] = bt_dev.sent_cmd[i];
+		bt_dev.sent_cmd[i] = NULL;
+	}
+	bt_dev.sent_cmd_count = 0U;
+
+	irq_unlock(key);
+
+	for (i = 0U; i < count; i++) {
+		BT_WARN("Uncleared pending opcode 0x%04x",
+			cmd(flushed[i])->opcode);
+		hci_cmd_finish(flushed[i], BT_HCI_ERR_UNSPECIFIED, flushed[i]);
+	}
+
+	return count;
+}
+
+static void hci_cmd_done(uint16_t opcode, uint8_t status,
+			 struct net_buf *evt_buf)
+{
+	struct net_buf *buf;
+
+	BT_DBG("opcode 0x%04x status 0x%02x buf %p", opcode, status, evt_buf);
+
+	buf = sent_cmd_take(opcode, NULL);
+	if (!buf) {
+		/* A NOP completion only carries the ncmd value */
+		if (opcode != BT_OP_NOP) {
+			BT_WARN("Unexpected completion of opcode 0x%04x",
+				opcode);
+		}
+		return;
+	}
+
+	hci_cmd_finish(buf, status, evt_buf);
+}
+
+static void hci_cmd_ncmd(uint8_t ncmd)
+{
+	unsigned int key;
+
+	/* ncmd already counts the free slots after this completion, it
+	 * replaces the credits rather than bounding the outstanding count.
+	 */
+	key = irq_lock();
+	bt_dev.ncmd = MIN(ncmd, CONFIG_BT_HCI_CMD_PIPELINE);
+	irq_unlock(key);
+
+	/* Allow next command to be sent */
+	if (ncmd) {
+		k_sem_give(&bt_dev.ncmd_sem);
+	}
 }
 
 static void hci_cmd_complete(struct net_buf *buf)
@@ -2077,10 +2203,7 @@ static void hci_cmd_complete(struct net_buf *buf)
 
 	hci_cmd_done(opcode, status, buf);
 
-	/* Allow next command to be sent */
-	if (ncmd) {
-		k_sem_give(&bt_dev.ncmd_sem);
-	}
+	hci_cmd_ncmd(ncmd);
 }
 
 static void hci_cmd_status(struct net_buf *buf)
@@ -2097,10 +2220,7 @@ static void hci_cmd_status(struct net_buf *buf)
 
 	hci_cmd_done(opcode, evt->status, buf);
 
-	/* Allow next command to be sent */
-	if (ncmd) {
-		k_sem_give(&bt_dev.ncmd_sem);
-	}
+	hci_cmd_ncmd(ncmd);
 }
 
 int bt_hci_get_conn_handle(const struct bt_conn *conn, uint16_t *conn_handle)
@@ -2374,18 +2494,20 @@ static void send_cmd(void)
 	buf = net_buf_get(&bt_dev.cmd_tx_queue, K_NO_WAIT);
 	BT_ASSERT(buf);
 
-	/* Wait until ncmd > 0 */
-	BT_DBG("calling sem_take_wait");
-	k_sem_take(&bt_dev.ncmd_sem, K_FOREVER);
+	/* The controller discards outstanding commands on reset, so a
+	 * completion that never came must not hold the credits forever.
+	 */
+	if (cmd(buf)->opcode == BT_HCI_OP_RESET && sent_cmd_flush()) {
+		hci_cmd_ncmd(1U);
+	}
 
-	/* Clear out any existing sent command */
-	if (bt_dev.sent_cmd) {
-		BT_ERR("Uncleared pending sent_cmd");
-		net_buf_unref(bt_dev.sent_cmd);
-		bt_dev.sent_cmd = NULL;
+	/* Wait until the controller can take one more command */
+	BT_DBG("calling sem_take_wait");
+	while (!sent_cmd_add(buf)) {
+		k_sem_take(&bt_dev.ncmd_sem, K_FOREVER);
 	}
 
-	bt_dev.sent_cmd = net_buf_ref(buf);
+	net_buf_ref(buf);
 
 	BT_DBG("Sending command 0x%04x (buf %p) to driver",
 	       cmd(buf)->opcode, buf);
@@ -2393,8 +2515,8 @@ static void send_cmd(void)
 	err = bt_send(buf);
 	if (err) {
 		BT_ERR("Unable to send to driver (err %d)", err);
-		k_sem_give(&bt_dev.ncmd_sem);
-		hci_cmd_done(cmd(buf)->opcode, BT_HCI_ERR_UNSPECIFIED, buf);
+		hci_cmd_finish(sent_cmd_take(0, buf), BT_HCI_ERR_UNSPECIFIED,
+			       buf);
 		net_buf_unref(buf);
 	}
 }
@@ -2647,6 +2769,63 @@ static void le_read_resolving_list_size_complete(struct net_buf *buf)
 }
 #endif /* defined(CONFIG_BT_SMP) */
 
+struct hci_cmd_read {
+	uint16_t opcode;
+	void (*complete)(struct net_buf *rsp);
+};
+
+/* Never hold every command buffer while waiting to allocate another */
+#define HCI_CMD_READ_WINDOW MIN(CONFIG_BT_HCI_CMD_PIPELINE, \
+				CONFIG_BT_BUF_CMD_TX_COUNT - 1)
+
+/* Issue independent parameterless commands with up to
+ * HCI_CMD_READ_WINDOW of them in flight, handing the responses to their
+ * handlers in order. Stops issuing at the first error and returns it.
+ */
+static int hci_cmd_read_batch(const struct hci_cmd_read *cmds, size_t count)
+{
+	struct net_buf *pending[MAX(HCI_CMD_READ_WINDOW, 1)];
+	size_t sent = 0, done = 0;
+	struct net_buf *rsp;
+	int err = 0, ret;
+
+	while (done < count) {
+		if (!err && sent < count &&
+		    sent - done < ARRAY_SIZE(pending)) {
+			err = bt_hci_cmd_send_sync_begin(cmds[sent].opcode, NULL,
+				&pending[sent % ARRAY_SIZE(pending)]);
+			if (!err) {
+				sent++;
+				continue;
+			}
+		}
+
+		if (done == sent) {
+			break;
+		}
+
+		ret = bt_hci_cmd_send_sync_end(pending[done % ARRAY_SIZE(pending)],
+					       &rsp);
+		if (!ret) {
+			if (!err) {
+				cmds[done].complete(rsp);
+			}
+			net_buf_unref(rsp);
+		} else if (!err) {
+			err = ret;
+		}
+
+		done++;
+	}
+
+	return err;
+}
+
+static const struct hci_cmd_read common_reads[] = {
+	{ BT_HCI_OP_READ_LOCAL_FEATURES, read_local_features_complete },
+	{ BT_HCI_OP_READ_SUPPORTED_COMMANDS, read_supported_commands_complete },
+};
+
 static int common_init(void)
 {
 	struct net_buf *rsp;
@@ -2662,31 +2841,25 @@ static int common_init(void)
 		net_buf_unref(rsp);
 	}
 
-	/* Read Local Supported Features */
-	err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_LOCAL_FEATURES, NULL, &rsp);
-	if (err) {
-		return err;
-	}
-	read_local_features_complete(rsp);
-	net_buf_unref(rsp);
-
-	/* Read Local Version Information */
+	/* Read Local Version Information, which also tells whether cached
+	 * controller capabilities can be used.
+	 */
 	err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_LOCAL_VERSION_INFO, NULL,
 				   &rsp);
 	if (err) {
 		return err;
 	}
 	read_local_ver_complete(rsp);
+#if defined(CONFIG_BT_HCI_CACHE)
+	bt_hci_cache_init(rsp);
+#endif /* CONFIG_BT_HCI_CACHE */
 	net_buf_unref(rsp);
 
-	/* Read Local Supported Commands */
-	err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_SUPPORTED_COMMANDS, NULL,
-				   &rsp);
+	/* Read Local Supported Features and Supported Commands */
+	err = hci_cmd_read_batch(common_reads, ARRAY_SIZE(common_reads));
 	if (err) {
 		return err;
 	}
-	read_supported_commands_complete(rsp);
-	net_buf_unref(rsp);
 
 	if (IS_ENABLED(CONFIG_BT_HOST_CRYPTO_PRNG)) {
 		/* Initialize the PRNG so that it is safe to use it later
@@ -3356,6 +3529,10 @@ static int hci_init(void)
 		return err;
 	}
 
+#if defined(CONFIG_BT_HCI_CACHE)
+	bt_hci_cache_commit();
+#endif /* CONFIG_BT_HCI_CACHE */
+
 	return 0;
 }
 
@@ -3419,6 +3596,14 @@ static void rx_queue_put(struct net_buf *buf)
 {
 	net_buf_slist_put(&bt_dev.rx_queue, buf);
 
+#if defined(CONFIG_BT_RECV_BATCH)
+	uint32_t depth = atomic_inc(&bt_dev.rx_depth) + 1;
+
+	if (depth > bt_dev.rx_stats.depth_max) {
+		bt_dev.rx_stats.depth_max = depth;
+	}
+#endif
+
 #if defined(CONFIG_BT_RECV_WORKQ_SYS)
 	const int err = k_work_submit(&rx_work);
 #elif defined(CONFIG_BT_RECV_WORKQ_BT)
@@ -3570,18 +3755,8 @@ static void init_work(struct k_work *work)
 }
 
 #if !defined(CONFIG_BT_RECV_BLOCKING)
-static void rx_work_handler(struct k_work *work)
+static void rx_process(struct net_buf *buf)
 {
-	int err;
-
-	struct net_buf *buf;
-
-	BT_DBG("Getting net_buf from queue");
-	buf = net_buf_slist_get(&bt_dev.rx_queue);
-	if (!buf) {
-		return;
-	}
-
 	BT_DBG("buf %p type %u len %u", buf, bt_buf_get_type(buf),
 	       buf->len);
 
@@ -3604,6 +3779,89 @@ static void rx_work_handler(struct k_work *work)
 		net_buf_unref(buf);
 		break;
 	}
+}
+
+#if defined(CONFIG_BT_RECV_BATCH)
+/* Handle queued buffers in order until the queue runs dry or one buffer
+ * type has used up its budget, and return how many were handled.
+ */
+static uint32_t rx_process_batch(bool *budget_hit)
+{
+	uint16_t evt = CONFIG_BT_RECV_BATCH_EVT;
+	uint16_t acl = CONFIG_BT_RECV_BATCH_ACL;
+#if defined(CONFIG_BT_ISO)
+	uint16_t iso = CONFIG_BT_RECV_BATCH_ISO;
+#endif
+	struct net_buf *buf;
+	uint32_t count = 0U;
+	uint16_t left;
+
+	*budget_hit = false;
+
+	while ((buf = net_buf_slist_get(&bt_dev.rx_queue))) {
+		atomic_dec(&bt_dev.rx_depth);
+		count++;
+
+		switch (bt_buf_get_type(buf)) {
+		case BT_BUF_ACL_IN:
+			left = --acl;
+			break;
+#if defined(CONFIG_BT_ISO)
+		case BT_BUF_ISO_IN:
+			left = --iso;
+			break;
+#endif /* CONFIG_BT_ISO */
+		default:
+			left = --evt;
+			break;
+		}
+
+		rx_process(buf);
+
+		if (!left) {
+			*budget_hit = true;
+			break;
+		}
+	}
+
+	return count;
+}
+#endif /* CONFIG_BT_RECV_BATCH */
+
+static void rx_work_handler(struct k_work *work)
+{
+	int err;
+
+#if defined(CONFIG_BT_RECV_BATCH)
+	bool budget_hit;
+	uint32_t count;
+
+	count = rx_process_batch(&budget_hit);
+	if (!count) {
+		return;
+	}
+
+	bt_dev.rx_stats.batches++;
+	bt_dev.rx_stats.bufs += count;
+	bt_dev.rx_stats.batch_last = count;
+	if (count > bt_dev.rx_stats.batch_max) {
+		bt_dev.rx_stats.batch_max = count;
+	}
+
+	if (budget_hit) {
+		bt_dev.rx_stats.budget_hits++;
+	}
+#else
+	struct net_buf *buf;
+
+	BT_DBG("Getting net_buf from queue");
+	buf = net_buf_slist_get(&bt_dev.rx_queue);
+	if (!buf) {
+		return;
+	}
+
+	rx_process(buf);
+#endif /* CONFIG_BT_RECV_BATCH */
 
 	/* Schedule the work handler to be executed again if there are
 	 * additional items in the queue. This allows for other users of the
@@ -3730,6 +3988,13 @@ int bt_disable(void)
 	k_thread_abort(&bt_workq.thread);
 #endif
 
+	/* Fail commands the closed controller will never complete and give
+	 * the next bt_enable() the initial command credit back.
+	 */
+	sent_cmd_flush();
+	bt_dev.ncmd = IS_ENABLED(CONFIG_BT_WAIT_NOP) ? 0U : 1U;
+	k_sem_reset(&bt_dev.ncmd_sem);
+
 	if (IS_ENABLED(CONFIG_BT_TINYCRYPT_ECC)) {
 		bt_hci_ecc_deinit();
 	}
@@ -335,17 +335,30 @@ struct bt_dev {
 	struct bt_dev_br	br;
 #endif
 
-	/* Number of commands controller can accept */
+	/* Signalled when the controller may accept more commands */
 	struct k_sem		ncmd_sem;
 
-	/* Last sent HCI command */
-	struct net_buf		*sent_cmd;
+	/* Command credits: the last reported ncmd less commands sent since */
+	uint8_t			ncmd;
+
+	/* Number of entries in sent_cmd */
+	uint8_t			sent_cmd_count;
+
+	/* Sent HCI commands awaiting completion, oldest first */
+	struct net_buf		*sent_cmd[CONFIG_BT_HCI_CMD_PIPELINE];
 
 #if !defined(CONFIG_BT_RECV_BLOCKING)
 	/* Queue for incoming HCI events & ACL data */
 	sys_slist_t rx_queue;
 #endif
 
+#if defined(CONFIG_BT_RECV_BATCH)
+	/* Number of buffers in rx_queue */
+	atomic_t rx_depth;
+
+	struct bt_hci_rx_stats rx_stats;
+#endif
+
 	/* Queue for outgoing HCI commands */
 	struct k_fifo		cmd_tx_queue;
 
@@ -389,6 +402,19 @@ struct bt_hci_cmd_state_set {
 	bool val;
 };
 
+/* Split form of bt_hci_cmd_send_sync(), letting a caller have several
+ * commands in flight before collecting their responses in order.
+ */
+int bt_hci_cmd_send_sync_begin(uint16_t opcode, struct net_buf *buf,
+			       struct net_buf **pending);
+int bt_hci_cmd_send_sync_end(struct net_buf *pending, struct net_buf **rsp);
+
+/* Controller capability cache, see CONFIG_BT_HCI_CACHE */
+void bt_hci_cache_init(struct net_buf *ver_rsp);
+bool bt_hci_cache_get(uint16_t opcode, struct net_buf *buf);
+void bt_hci_cache_put(uint16_t opcode, struct net_buf *rsp);
+void bt_hci_cache_commit(void);
+
 /* Set command state related with the command buffer */
 void bt_hci_cmd_state_set_init(struct net_buf *buf,
 			       struct bt_hci_cmd_state_set *state,
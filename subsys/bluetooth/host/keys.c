@@ -15,6 +15,14 @@
 
 #include <settings/settings.h>
 
+/* Resolve RPAs with pre-expanded IRKs instead of through bt_encrypt_le() */
+#if defined(CONFIG_BT_RPA_CACHE) && defined(CONFIG_BT_HOST_CRYPTO) && \
+    !defined(CONFIG_BT_CTLR)
+#define KEYS_IRK_SCHED
+#include <tinycrypt/constants.h>
+#include <tinycrypt/aes.h>
+#endif
+
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/buf.h>
 #include <bluetooth/conn.h>
@@ -209,30 +217,151 @@ struct bt_keys *bt_keys_get_type(int type, uint8_t id, const bt_addr_le_t *addr)
 	return keys;
 }
 
-struct bt_keys *bt_keys_find_irk(uint8_t id, const bt_addr_le_t *addr)
+#if defined(CONFIG_BT_RPA_CACHE)
+/* Consecutive slots probed for an RPA before replacing the oldest one */
+#define RPA_CACHE_WAYS     MIN(4, CONFIG_BT_RPA_CACHE_SIZE)
+#define RPA_CACHE_TIMEOUT  (CONFIG_BT_RPA_CACHE_TIMEOUT * MSEC_PER_SEC)
+
+struct rpa_cache_entry {
+	bt_addr_t rpa;
+	uint8_t   id;
+	/* Index in key_pool plus one, 0 if no IRK matched the RPA */
+	uint8_t   keys;
+	/* Entries from an older generation are stale */
+	uint16_t  gen;
+	/* Last use of a resolved RPA, first sighting of an unresolved one */
+	uint32_t  stamp;
+};
+
+BUILD_ASSERT(CONFIG_BT_MAX_PAIRED < UINT8_MAX);
+
+static struct rpa_cache_entry rpa_cache[CONFIG_BT_RPA_CACHE_SIZE];
+static uint16_t rpa_cache_gen = 1U;
+
+void bt_keys_rpa_cache_clear(void)
 {
-	int i;
+	/* Generation 0 is never valid so zeroed entries stay unused */
+	if (!++rpa_cache_gen) {
+		rpa_cache_gen = 1U;
+	}
+}
 
-	BT_DBG("%s", bt_addr_le_str(addr));
+static size_t rpa_cache_hash(const bt_addr_t *rpa)
+{
+	/* Both halves of an RPA are already pseudo random */
+	return (sys_get_le24(&rpa->val[0]) ^ sys_get_le24(&rpa->val[3])) %
+	       CONFIG_BT_RPA_CACHE_SIZE;
+}
 
-	if (!bt_addr_le_is_rpa(addr)) {
-		return NULL;
+static bool rpa_cache_valid(const struct rpa_cache_entry *entry, uint32_t now)
+{
+	if (entry->gen != rpa_cache_gen) {
+		return false;
 	}
 
-	for (i = 0; i < ARRAY_SIZE(key_pool); i++) {
-		if (!(key_pool[i].keys & BT_KEYS_IRK)) {
-			continue;
+	return entry->keys || (now - entry->stamp) < RPA_CACHE_TIMEOUT;
+}
+
+static struct rpa_cache_entry *rpa_cache_lookup(uint8_t id, const bt_addr_t *rpa,
+						struct rpa_cache_entry **victim)
+{
+	uint32_t now = k_uptime_get_32();
+	size_t idx = rpa_cache_hash(rpa);
+	bool victim_valid = false;
+	int i;
+
+	*victim = NULL;
+
+	for (i = 0; i < RPA_CACHE_WAYS; i++) {
+		struct rpa_cache_entry *entry;
+		bool valid;
+
+		entry = &rpa_cache[(idx + i) % CONFIG_BT_RPA_CACHE_SIZE];
+		valid = rpa_cache_valid(entry, now);
+
+		if (valid && entry->id == id && !bt_addr_cmp(&entry->rpa, rpa)) {
+			if (entry->keys) {
+				entry->stamp = now;
+			}
+
+			return entry;
 		}
 
-		if (key_pool[i].id == id &&
-		    !bt_addr_cmp(&addr->a, &key_pool[i].irk.rpa)) {
-			BT_DBG("cached RPA %s for %s",
-			       bt_addr_str(&key_pool[i].irk.rpa),
-			       bt_addr_le_str(&key_pool[i].addr));
-			return &key_pool[i];
+		if (!valid) {
+			if (!*victim || victim_valid) {
+				*victim = entry;
+				victim_valid = false;
+			}
+		} else if (!*victim ||
+			   (victim_valid &&
+			    (int32_t)(entry->stamp - (*victim)->stamp) < 0)) {
+			*victim = entry;
+			victim_valid = true;
 		}
 	}
 
+	return NULL;
+}
+
+static void rpa_cache_add(struct rpa_cache_entry *entry, uint8_t id,
+			  const bt_addr_t *rpa, struct bt_keys *keys)
+{
+	bt_addr_copy(&entry->rpa, rpa);
+	entry->id = id;
+	entry->keys = keys ? (keys - key_pool) + 1 : 0U;
+	entry->gen = rpa_cache_gen;
+	entry->stamp = k_uptime_get_32();
+}
+
+#if defined(KEYS_IRK_SCHED)
+/* Expanded AES key of each bonded IRK so that resolving an RPA against all
+ * bonds costs one block encryption per IRK and nothing else.
+ */
+static struct {
+	struct tc_aes_key_sched_struct sched;
+	uint16_t gen;
+} irk_sched[CONFIG_BT_MAX_PAIRED];
+
+static bool irk_sched_matches(int i, const uint8_t r[16], const bt_addr_t *rpa)
+{
+	uint8_t enc[16];
+
+	if (irk_sched[i].gen != rpa_cache_gen) {
+		uint8_t irk[16];
+
+		sys_memcpy_swap(irk, key_pool[i].irk.val, 16);
+
+		if (tc_aes128_set_encrypt_key(&irk_sched[i].sched, irk) ==
+		    TC_CRYPTO_FAIL) {
+			return false;
+		}
+
+		irk_sched[i].gen = rpa_cache_gen;
+	}
+
+	if (tc_aes_encrypt(enc, r, &irk_sched[i].sched) == TC_CRYPTO_FAIL) {
+		return false;
+	}
+
+	/* ah() is the least significant 24 bits of e(irk, r'), which are
+	 * the last bytes of the big endian output.
+	 */
+	return rpa->val[0] == enc[15] && rpa->val[1] == enc[14] &&
+	       rpa->val[2] == enc[13];
+}
+#endif /* KEYS_IRK_SCHED */
+#endif /* CONFIG_BT_RPA_CACHE */
+
+static struct bt_keys *keys_resolve_irk(uint8_t id, const bt_addr_t *rpa)
+{
+#if defined(KEYS_IRK_SCHED)
+	uint8_t r[16] = { 0 };
+
+	/* r' = padding || prand, shared by all IRKs and big endian here */
+	sys_memcpy_swap(&r[13], &rpa->val[3], 3);
+#endif
+	int i;
+
 	for (i = 0; i < ARRAY_SIZE(key_pool); i++) {
 		if (!(key_pool[i].keys & BT_KEYS_IRK)) {
 			continue;
@@ -242,22 +371,87 @@ struct bt_keys *bt_keys_find_irk(uint8_t id, const bt_addr_le_t *addr)
 			continue;
 		}
 
-		if (bt_rpa_irk_matches(key_pool[i].irk.val, &addr->a)) {
+#if defined(KEYS_IRK_SCHED)
+		if (irk_sched_matches(i, r, rpa)) {
+#else
+		if (bt_rpa_irk_matches(key_pool[i].irk.val, rpa)) {
+#endif
 			BT_DBG("RPA %s matches %s",
 			       bt_addr_str(&key_pool[i].irk.rpa),
 			       bt_addr_le_str(&key_pool[i].addr));
 
-			bt_addr_copy(&key_pool[i].irk.rpa, &addr->a);
+			bt_addr_copy(&key_pool[i].irk.rpa, rpa);
 
 			return &key_pool[i];
 		}
 	}
 
-	BT_DBG("No IRK for %s", bt_addr_le_str(addr));
-
 	return NULL;
 }
 
+struct bt_keys *bt_keys_find_irk(uint8_t id, const bt_addr_le_t *addr)
+{
+#if defined(CONFIG_BT_RPA_CACHE)
+	struct rpa_cache_entry *entry, *victim;
+#endif
+	struct bt_keys *keys;
+	int i;
+
+	BT_DBG("%s", bt_addr_le_str(addr));
+
+	if (!bt_addr_le_is_rpa(addr)) {
+		return NULL;
+	}
+
+#if defined(CONFIG_BT_RPA_CACHE)
+	entry = rpa_cache_lookup(id, &addr->a, &victim);
+	if (entry) {
+		if (!entry->keys) {
+			BT_DBG("No IRK for %s (cached)", bt_addr_le_str(addr));
+			return NULL;
+		}
+
+		keys = &key_pool[entry->keys - 1];
+
+		/* Keep the last resolved RPA current, as a full resolve would */
+		bt_addr_copy(&keys->irk.rpa, &addr->a);
+
+		return keys;
+	}
+#endif /* CONFIG_BT_RPA_CACHE */
+
+	keys = NULL;
+
+	for (i = 0; i < ARRAY_SIZE(key_pool); i++) {
+		if (!(key_pool[i].keys & BT_KEYS_IRK)) {
+			continue;
+		}
+
+		if (key_pool[i].id == id &&
+		    !bt_addr_cmp(&addr->a, &key_pool[i].irk.rpa)) {
+			BT_DBG("cached RPA %s for %s",
+			       bt_addr_str(&key_pool[i].irk.rpa),
+			       bt_addr_le_str(&key_pool[i].addr));
+			keys = &key_pool[i];
+			break;
+		}
+	}
+
+	if (!keys) {
+		keys = keys_resolve_irk(id, &addr->a);
+	}
+
+#if defined(CONFIG_BT_RPA_CACHE)
+	rpa_cache_add(victim, id, &addr->a, keys);
+#endif
+
+	if (!keys) {
+		BT_DBG("No IRK for %s", bt_addr_le_str(addr));
+	}
+
+	return keys;
+}
+
 struct bt_keys *bt_keys_find_addr(uint8_t id, const bt_addr_le_t *addr)
 {
 	int i;
@@ -277,6 +471,10 @@ struct bt_keys *bt_keys_find_addr(uint8_t id, const bt_addr_le_t *addr)
 void bt_keys_add_type(struct bt_keys *keys, int type)
 {
 	keys->keys |= type;
+
+	if (type & BT_KEYS_IRK) {
+		bt_keys_rpa_cache_clear();
+	}
 }
 
 void bt_keys_clear(struct bt_keys *keys)
@@ -306,7 +504,14 @@ void bt_keys_clear(struct bt_keys *keys)
 		settings_delete(key);
 	}
 
+#if defined(KEYS_IRK_SCHED)
+	/* Wipe the expanded IRK, generation 0 is never valid */
+	(void)memset(&irk_sched[keys - key_pool], 0,
+		     sizeof(irk_sched[keys - key_pool]));
+#endif /* KEYS_IRK_SCHED */
+
 	(void)memset(keys, 0, sizeof(*keys));
+	bt_keys_rpa_cache_clear();
 }
 
 #if defined(CONFIG_BT_SETTINGS)
@@ -388,6 +593,7 @@ static int keys_set(const char *name, size_t len_rd, settings_read_cb read_cb,
 		keys = bt_keys_find(BT_KEYS_ALL, id, &addr);
 		if (keys) {
 			(void)memset(keys, 0, sizeof(*keys));
+			bt_keys_rpa_cache_clear();
 			BT_DBG("Cleared keys for %s", bt_addr_le_str(&addr));
 		} else {
 			BT_WARN("Unable to find deleted keys for %s",
@@ -422,6 +628,8 @@ static int keys_set(const char *name, size_t len_rd, settings_read_cb read_cb,
 		memcpy(keys->storage_start, val, len);
 	}
 
+	bt_keys_rpa_cache_clear();
+
 	BT_DBG("Successfully restored keys for %s", bt_addr_le_str(&addr));
 #if IS_ENABLED(CONFIG_BT_KEYS_OVERWRITE_OLDEST)
 	if (aging_counter_val < keys->aging_counter) {
@@ -85,6 +85,15 @@ struct bt_keys *bt_keys_find_addr(uint8_t id, const bt_addr_le_t *addr);
 void bt_keys_add_type(struct bt_keys *keys, int type);
 void bt_keys_clear(struct bt_keys *keys);
 
+#if defined(CONFIG_BT_RPA_CACHE)
+/* Drop all cached RPA resolutions, needed whenever an IRK changes */
+void bt_keys_rpa_cache_clear(void);
+#else
+static inline void bt_keys_rpa_cache_clear(void)
+{
+}
+#endif
+
 #if defined(CONFIG_BT_SETTINGS)
 int bt_keys_store(struct bt_keys *keys);
 #else
@@ -621,7 +621,7 @@ int bt_l2cap_send_cb(struct bt_conn *conn, uint16_t cid, struct net_buf *buf,
 	BT_DBG("conn %p cid %u len %zu", conn, cid, net_buf_frags_len(buf));
 
 	hdr = net_buf_push(buf, sizeof(*hdr));
-	hdr->len = sys_cpu_to_le16(buf->len - sizeof(*hdr));
+	hdr->len = sys_cpu_to_le16(net_buf_frags_len(buf) - sizeof(*hdr));
 	hdr->cid = sys_cpu_to_le16(cid);
 
 	return bt_conn_send_cb(conn, buf, cb, user_data);
@@ -804,6 +804,116 @@ int bt_l2cap_server_register(struct bt_l2cap_server *server)
 	return 0;
 }
 
+#if defined(CONFIG_BT_L2CAP_CREDITS_ADAPTIVE)
+/* Connection events the K-frame rate is measured over */
+#define CREDITS_WINDOW_EVENTS 8
+
+static uint16_t l2cap_credits_clamp(struct bt_l2cap_le_chan *chan,
+				    uint32_t credits)
+{
+	uint16_t frames = chan->_credits.sdu_frames;
+
+	/* At least the SDU being received, as without adaptive credits.
+	 * Credits for the next one only as far as the K-frames the peer
+	 * may then send at once still fit the ACL RX buffers.
+	 */
+	return CLAMP(credits, frames,
+		     MAX(frames, MIN(2U * frames, L2CAP_LE_MAX_CREDITS)));
+}
+
+static uint16_t l2cap_credits_init(struct bt_l2cap_le_chan *chan)
+{
+	struct bt_conn *conn = chan->chan.conn;
+	uint32_t frame_us, frames = 0U;
+
+	chan->_credits.sdu_frames =
+		ceiling_fraction(chan->rx.mtu + BT_L2CAP_SDU_HDR_SIZE,
+				 chan->rx.mps);
+	chan->_credits.window_start = k_uptime_get_32();
+
+	/* Outgoing channels are not added to the connection yet, they start
+	 * from a single SDU and adapt once data flows.
+	 */
+	if (conn) {
+		/* Air time of a full K-frame and its empty acknowledgment on
+		 * the 1M PHY, the slowest one the link may be using.
+		 */
+		frame_us = (chan->rx.mps + BT_L2CAP_HDR_SIZE + 10U) * 8U +
+			   80U + 2U * 150U;
+		frames = conn->le.interval * 1250U / frame_us;
+	}
+
+	/* Credits given reach the peer one connection event later */
+	chan->_credits.target = l2cap_credits_clamp(chan, 2U * frames);
+
+	return chan->_credits.target;
+}
+
+static void l2cap_credits_frame(struct bt_l2cap_le_chan *chan)
+{
+	uint32_t now = k_uptime_get_32();
+	uint32_t interval_us, window_ms, elapsed, rate;
+
+	chan->_credits.frames++;
+
+	if (!atomic_get(&chan->rx.credits)) {
+		chan->_credits.rx_stalls++;
+	}
+
+	if (!chan->_credits.target) {
+		return;
+	}
+
+	interval_us = chan->chan.conn->le.interval * 1250U;
+	window_ms = MAX(1U, interval_us * CREDITS_WINDOW_EVENTS / 1000U);
+	elapsed = now - chan->_credits.window_start;
+
+	chan->_credits.window_frames++;
+
+	if (elapsed < window_ms) {
+		return;
+	}
+
+	/* Restart without a sample after the channel has been idle */
+	if (elapsed < 4U * window_ms) {
+		rate = (uint64_t)chan->_credits.window_frames * interval_us /
+		       (elapsed * 1000U);
+		chan->_credits.target = l2cap_credits_clamp(chan, 2U * rate + 1U);
+
+		BT_DBG("chan %p rate %u target %u", chan, rate,
+		       chan->_credits.target);
+	}
+
+	chan->_credits.window_frames = 0U;
+	chan->_credits.window_start = now;
+}
+
+static void l2cap_chan_send_credits(struct bt_l2cap_le_chan *chan,
+				    struct net_buf *buf, uint16_t credits);
+
+/* Returns false if the channel is not managed adaptively right now */
+static bool l2cap_credits_refill(struct bt_l2cap_le_chan *chan,
+				 struct net_buf *buf)
+{
+	atomic_val_t credits = atomic_get(&chan->rx.credits);
+
+	/* SDUs held by the application get their credits back on
+	 * bt_l2cap_chan_recv_complete().
+	 */
+	if (!chan->_credits.target || chan->_credits.held) {
+		return false;
+	}
+
+	/* Top up in batches, each update costs a signaling PDU */
+	if (credits <= chan->_credits.target / 2U) {
+		l2cap_chan_send_credits(chan, buf,
+					chan->_credits.target - credits);
+	}
+
+	return true;
+}
+#endif /* CONFIG_BT_L2CAP_CREDITS_ADAPTIVE */
+
 static void l2cap_chan_rx_init(struct bt_l2cap_le_chan *chan)
 {
 	BT_DBG("chan %p", chan);
@@ -831,13 +941,22 @@ static void l2cap_chan_rx_init(struct bt_l2cap_le_chan *chan)
 		chan->rx.mtu = chan->rx.mps - BT_L2CAP_SDU_HDR_SIZE;
 	}
 
+#if defined(CONFIG_BT_L2CAP_CREDITS_ADAPTIVE)
+	(void)memset(&chan->_credits, 0, sizeof(chan->_credits));
+#endif /* CONFIG_BT_L2CAP_CREDITS_ADAPTIVE */
+
 	/* Use existing credits if defined */
 	if (!chan->rx.init_credits) {
 		if (chan->chan.ops->alloc_buf) {
+#if defined(CONFIG_BT_L2CAP_CREDITS_ADAPTIVE)
+			/* Auto tune credits to the link */
+			chan->rx.init_credits = l2cap_credits_init(chan);
+#else
 			/* Auto tune credits to receive a full packet */
 			chan->rx.init_credits =
 				ceiling_fraction(chan->rx.mtu,
 						 BT_L2CAP_RX_MTU);
+#endif /* CONFIG_BT_L2CAP_CREDITS_ADAPTIVE */
 		} else {
 			chan->rx.init_credits = L2CAP_LE_MAX_CREDITS;
 		}
@@ -1727,6 +1846,46 @@ static void le_disconn_rsp(struct bt_l2cap *l2cap, uint8_t ident,
 	bt_l2cap_chan_del(&chan->chan);
 }
 
+#if defined(CONFIG_BT_L2CAP_SEG_VIEW)
+/* Views into part of an SDU being sent, or of a received K-frame */
+BT_BUF_VIEW_POOL_DEFINE(seg_tx_view_pool, CONFIG_BT_L2CAP_TX_BUF_COUNT);
+BT_BUF_VIEW_POOL_DEFINE(seg_rx_view_pool, CONFIG_BT_L2CAP_SEG_VIEW_RX_COUNT);
+
+/* Each view holds an ACL RX buffer, so leave some for the controller */
+BUILD_ASSERT(CONFIG_BT_L2CAP_SEG_VIEW_RX_COUNT < CONFIG_BT_BUF_ACL_RX_COUNT);
+
+static bool l2cap_seg_view_add(struct net_buf_pool *pool, struct net_buf *head,
+			       struct net_buf *buf, uint16_t len)
+{
+	struct net_buf *view;
+
+	view = bt_buf_view_alloc(pool, buf, len, K_NO_WAIT);
+	if (!view) {
+		return false;
+	}
+
+	net_buf_frag_add(head, view);
+
+	return true;
+}
+
+static bool l2cap_seg_view_tx(struct bt_conn *conn, struct net_buf *seg,
+			      struct net_buf *buf, uint16_t len)
+{
+	if (!bt_conn_acl_single_pkt(conn, seg->len + len)) {
+		return false;
+	}
+
+	return l2cap_seg_view_add(&seg_tx_view_pool, seg, buf, len);
+}
+
+#define l2cap_seg_view_rx(sdu, buf) \
+	l2cap_seg_view_add(&seg_rx_view_pool, sdu, buf, (buf)->len)
+#else
+#define l2cap_seg_view_tx(conn, seg, buf, len) false
+#define l2cap_seg_view_rx(sdu, buf) false
+#endif /* CONFIG_BT_L2CAP_SEG_VIEW */
+
 static inline struct net_buf *l2cap_alloc_seg(struct net_buf *buf)
 {
 	struct net_buf_pool *pool = net_buf_pool_get(buf->pool_id);
@@ -1759,9 +1918,11 @@ static struct net_buf *l2cap_chan_create_seg(struct bt_l2cap_le_chan *ch,
 	headroom = BT_L2CAP_CHAN_SEND_RESERVE + sdu_hdr_len;
 
 	/* Check if original buffer has enough headroom and don't have any
-	 * fragments.
+	 * fragments. Earlier segments may reference the data right in front
+	 * of what is left, so only the first one can push its headers.
 	 */
-	if (net_buf_headroom(buf) >= headroom && !buf->frags) {
+	if (net_buf_headroom(buf) >= headroom && !buf->frags &&
+	    (sdu_hdr_len || !IS_ENABLED(CONFIG_BT_L2CAP_SEG_VIEW))) {
 		if (sdu_hdr_len) {
 			/* Push SDU length if set */
 			net_buf_push_le16(buf, net_buf_frags_len(buf));
@@ -1779,6 +1940,15 @@ segment:
 		net_buf_add_le16(seg, net_buf_frags_len(buf));
 	}
 
+	len = MIN(buf->len, ch->tx.mps - sdu_hdr_len);
+	if (l2cap_seg_view_tx(ch->chan.conn, seg, buf, len)) {
+		net_buf_pull(buf, len);
+
+		BT_DBG("ch %p seg %p view len %u", ch, seg, len);
+
+		return seg;
+	}
+
 	/* Don't send more that TX MPS including SDU length */
 	len = MIN(net_buf_tailroom(seg), ch->tx.mps - sdu_hdr_len);
 	/* Limit if original buffer is smaller than the segment */
@@ -1872,6 +2042,9 @@ static int l2cap_chan_le_send(struct bt_l2cap_le_chan *ch,
 
 	if (!test_and_dec(&ch->tx.credits)) {
 		BT_WARN("No credits to transmit packet");
+#if defined(CONFIG_BT_L2CAP_CREDITS_ADAPTIVE)
+		ch->_credits.tx_stalls++;
+#endif /* CONFIG_BT_L2CAP_CREDITS_ADAPTIVE */
 		return -EAGAIN;
 	}
 
@@ -1884,10 +2057,10 @@ static int l2cap_chan_le_send(struct bt_l2cap_le_chan *ch,
 		return -EAGAIN;
 	}
 
-	BT_DBG("ch %p cid 0x%04x len %u credits %lu", ch, ch->tx.cid,
-	       seg->len, atomic_get(&ch->tx.credits));
+	BT_DBG("ch %p cid 0x%04x len %zu credits %lu", ch, ch->tx.cid,
+	       net_buf_frags_len(seg), atomic_get(&ch->tx.credits));
 
-	len = seg->len - sdu_hdr_len;
+	len = net_buf_frags_len(seg) - sdu_hdr_len;
 
 	/* Set a callback if there is no data left in the buffer and sent
 	 * callback has been set.
@@ -2197,9 +2370,13 @@ static void l2cap_chan_send_credits(struct bt_l2cap_le_chan *chan,
 	__ASSERT_NO_MSG(bt_l2cap_chan_get_state(&chan->chan) == BT_L2CAP_CONNECTED);
 
 	/* Cap the number of credits given */
+#if defined(CONFIG_BT_L2CAP_CREDITS_ADAPTIVE)
+	credits = MIN(credits, MAX(chan->rx.init_credits, chan->_credits.target));
+#else
 	if (credits > chan->rx.init_credits) {
 		credits = chan->rx.init_credits;
 	}
+#endif /* CONFIG_BT_L2CAP_CREDITS_ADAPTIVE */
 
 	buf = l2cap_create_le_sig_pdu(buf, BT_L2CAP_LE_CREDITS, get_ident(),
 				      sizeof(*ev));
@@ -2261,6 +2438,17 @@ int bt_l2cap_chan_recv_complete(struct bt_l2cap_chan *chan, struct net_buf *buf)
 
 	BT_DBG("chan %p buf %p", chan, buf);
 
+#if defined(CONFIG_BT_L2CAP_CREDITS_ADAPTIVE)
+	if (le_chan->_credits.held) {
+		le_chan->_credits.held--;
+	}
+
+	if (l2cap_credits_refill(le_chan, buf)) {
+		net_buf_unref(buf);
+		return 0;
+	}
+#endif /* CONFIG_BT_L2CAP_CREDITS_ADAPTIVE */
+
 	/* Restore credits used by packet */
 	memcpy(&credits, net_buf_user_data(buf), sizeof(credits));
 
@@ -2271,6 +2459,36 @@ int bt_l2cap_chan_recv_complete(struct bt_l2cap_chan *chan, struct net_buf *buf)
 	return 0;
 }
 
+int bt_l2cap_chan_credit_stats_get(struct bt_l2cap_chan *chan,
+				   struct bt_l2cap_le_credit_stats *stats)
+{
+#if defined(CONFIG_BT_L2CAP_CREDITS_ADAPTIVE)
+	struct bt_l2cap_le_chan *le_chan;
+
+	__ASSERT_NO_MSG(chan);
+	__ASSERT_NO_MSG(stats);
+
+	if (!chan->conn || chan->conn->type != BT_CONN_TYPE_LE) {
+		return -ENOTCONN;
+	}
+
+	le_chan = BT_L2CAP_LE_CHAN(chan);
+
+	stats->credits = atomic_get(&le_chan->rx.credits);
+	stats->target = le_chan->_credits.target;
+	stats->frames = le_chan->_credits.frames;
+	stats->rx_stalls = le_chan->_credits.rx_stalls;
+	stats->tx_stalls = le_chan->_credits.tx_stalls;
+
+	return 0;
+#else
+	ARG_UNUSED(chan);
+	ARG_UNUSED(stats);
+
+	return -ENOTSUP;
+#endif /* CONFIG_BT_L2CAP_CREDITS_ADAPTIVE */
+}
+
 static struct net_buf *l2cap_alloc_frag(k_timeout_t timeout, void *user_data)
 {
 	struct bt_l2cap_le_chan *chan = user_data;
@@ -2302,11 +2520,24 @@ static void l2cap_chan_le_recv_sdu(struct bt_l2cap_le_chan *chan,
 			BT_ERR("err %d", err);
 			bt_l2cap_chan_disconnect(&chan->chan);
 			net_buf_unref(buf);
+			return;
 		}
+
+#if defined(CONFIG_BT_L2CAP_CREDITS_ADAPTIVE)
+		if (chan->_credits.target) {
+			chan->_credits.held++;
+		}
+#endif /* CONFIG_BT_L2CAP_CREDITS_ADAPTIVE */
 		return;
 	}
 
 	if (bt_l2cap_chan_get_state(&chan->chan) == BT_L2CAP_CONNECTED) {
+#if defined(CONFIG_BT_L2CAP_CREDITS_ADAPTIVE)
+		if (l2cap_credits_refill(chan, buf)) {
+			net_buf_unref(buf);
+			return;
+		}
+#endif /* CONFIG_BT_L2CAP_CREDITS_ADAPTIVE */
 		l2cap_chan_send_credits(chan, buf, seg);
 	}
 
@@ -2336,16 +2567,23 @@ static void l2cap_chan_le_recv_seg(struct bt_l2cap_le_chan *chan,
 
 	BT_DBG("chan %p seg %d len %zu", chan, seg, net_buf_frags_len(buf));
 
-	/* Append received segment to SDU */
-	len = net_buf_append_bytes(chan->_sdu, buf->len, buf->data, K_NO_WAIT,
-				   l2cap_alloc_frag, chan);
-	if (len != buf->len) {
-		BT_ERR("Unable to store SDU");
-		bt_l2cap_chan_disconnect(&chan->chan);
-		return;
+	/* Append received segment to SDU, by reference if possible */
+	if (!buf->len || !l2cap_seg_view_rx(chan->_sdu, buf)) {
+		len = net_buf_append_bytes(chan->_sdu, buf->len, buf->data,
+					   K_NO_WAIT, l2cap_alloc_frag, chan);
+		if (len != buf->len) {
+			BT_ERR("Unable to store SDU");
+			bt_l2cap_chan_disconnect(&chan->chan);
+			return;
+		}
 	}
 
 	if (net_buf_frags_len(chan->_sdu) < chan->_sdu_len) {
+#if defined(CONFIG_BT_L2CAP_CREDITS_ADAPTIVE)
+		if (l2cap_credits_refill(chan, buf)) {
+			return;
+		}
+#endif /* CONFIG_BT_L2CAP_CREDITS_ADAPTIVE */
 		/* Give more credits if remote has run out of them, this
 		 * should only happen if the remote cannot fully utilize the
 		 * MPS for some reason.
@@ -2376,6 +2614,10 @@ static void l2cap_chan_le_recv(struct bt_l2cap_le_chan *chan,
 		return;
 	}
 
+#if defined(CONFIG_BT_L2CAP_CREDITS_ADAPTIVE)
+	l2cap_credits_frame(chan);
+#endif /* CONFIG_BT_L2CAP_CREDITS_ADAPTIVE */
+
 	/* Check if segments already exist */
 	if (chan->_sdu) {
 		l2cap_chan_le_recv_seg(chan, buf);
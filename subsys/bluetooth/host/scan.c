@@ -28,9 +28,6 @@ static bt_le_scan_cb_t *scan_dev_found_cb;
 static sys_slist_t scan_cbs = SYS_SLIST_STATIC_INIT(&scan_cbs);
 
 #if defined(CONFIG_BT_EXT_ADV)
-/* A buffer used to reassemble advertisement data from the controller. */
-NET_BUF_SIMPLE_DEFINE(ext_scan_buf, CONFIG_BT_EXT_SCAN_BUF_SIZE);
-
 struct fragmented_advertiser {
 	bt_addr_le_t addr;
 	uint8_t sid;
@@ -39,9 +36,28 @@ struct fragmented_advertiser {
 		FRAG_ADV_REASSEMBLING,
 		FRAG_ADV_DISCARDING,
 	} state;
+	/* Uptime of the last fragment, to expire chains that never end. */
+	uint32_t stamp;
+	/* Used to reassemble advertisement data from the controller. */
+	struct net_buf_simple buf;
+	uint8_t data[CONFIG_BT_EXT_SCAN_BUF_SIZE];
 };
 
-static struct fragmented_advertiser reassembling_advertiser;
+static struct fragmented_advertiser
+	reassembling_advertisers[CONFIG_BT_EXT_SCAN_REASSEMBLY_COUNT];
+
+/* Longest gap between two fragments of one chain, in milliseconds. The
+ * AUX offset spans up to 8191 units of 300 us, so a chain still waiting
+ * for data after this has lost a fragment.
+ */
+#define FRAG_ADV_TIMEOUT 2500U
+
+static bool reassembling_advertiser_expired(const struct fragmented_advertiser *adv,
+					    uint32_t now)
+{
+	return adv->state != FRAG_ADV_INACTIVE &&
+	       now - adv->stamp > FRAG_ADV_TIMEOUT;
+}
 
 static bool fragmented_advertisers_equal(const struct fragmented_advertiser *a,
 					 const bt_addr_le_t *addr, uint8_t sid)
@@ -50,18 +66,83 @@ static bool fragmented_advertisers_equal(const struct fragmented_advertiser *a,
 	return a->sid == sid && bt_addr_le_cmp(&a->addr, addr) == 0;
 }
 
-/* Sets the address and sid of the advertiser to be reassembled. */
-static void init_reassembling_advertiser(const bt_addr_le_t *addr, uint8_t sid)
+static struct fragmented_advertiser *get_reassembling_advertiser(const bt_addr_le_t *addr,
+								 uint8_t sid)
+{
+	uint32_t now = k_uptime_get_32();
+
+	for (int i = 0; i < ARRAY_SIZE(reassembling_advertisers); i++) {
+		struct fragmented_advertiser *adv = &reassembling_advertisers[i];
+
+		if (adv->state != FRAG_ADV_INACTIVE &&
+		    fragmented_advertisers_equal(adv, addr, sid)) {
+			/* Don't append to data left from a lost chain */
+			if (reassembling_advertiser_expired(adv, now)) {
+				adv->state = FRAG_ADV_INACTIVE;
+				return NULL;
+			}
+
+			adv->stamp = now;
+			return adv;
+		}
+	}
+
+	return NULL;
+}
+
+/* Takes a free context for the advertiser to be reassembled, or else the
+ * one whose chain has gone quiet the longest if it has expired.
+ */
+static struct fragmented_advertiser *init_reassembling_advertiser(const bt_addr_le_t *addr,
+								  uint8_t sid)
+{
+	struct fragmented_advertiser *adv = NULL;
+	uint32_t now = k_uptime_get_32();
+
+	for (int i = 0; i < ARRAY_SIZE(reassembling_advertisers); i++) {
+		struct fragmented_advertiser *entry = &reassembling_advertisers[i];
+
+		if (entry->state == FRAG_ADV_INACTIVE) {
+			adv = entry;
+			break;
+		}
+
+		if (reassembling_advertiser_expired(entry, now) &&
+		    (!adv || (int32_t)(entry->stamp - adv->stamp) < 0)) {
+			adv = entry;
+		}
+	}
+
+	if (!adv) {
+		return NULL;
+	}
+
+	if (adv->state != FRAG_ADV_INACTIVE) {
+		BT_DBG("Evicting expired reassembly of %s sid %u",
+		       bt_addr_le_str(&adv->addr), adv->sid);
+	}
+
+	bt_addr_le_copy(&adv->addr, addr);
+	adv->sid = sid;
+	adv->state = FRAG_ADV_REASSEMBLING;
+	adv->stamp = now;
+	net_buf_simple_init_with_data(&adv->buf, adv->data,
+				      sizeof(adv->data));
+	net_buf_simple_reset(&adv->buf);
+
+	return adv;
+}
+
+static void reset_reassembling_advertiser(struct fragmented_advertiser *adv)
 {
-	bt_addr_le_copy(&reassembling_advertiser.addr, addr);
-	reassembling_advertiser.sid = sid;
-	reassembling_advertiser.state = FRAG_ADV_REASSEMBLING;
+	adv->state = FRAG_ADV_INACTIVE;
 }
 
-static void reset_reassembling_advertiser(void)
+static void reset_reassembling_advertisers(void)
 {
-	net_buf_simple_reset(&ext_scan_buf);
-	reassembling_advertiser.state = FRAG_ADV_INACTIVE;
+	for (int i = 0; i < ARRAY_SIZE(reassembling_advertisers); i++) {
+		reset_reassembling_advertiser(&reassembling_advertisers[i]);
+	}
 }
 
 #if defined(CONFIG_BT_PER_ADV_SYNC)
@@ -71,11 +152,39 @@ static sys_slist_t pa_sync_cbs = SYS_SLIST_STATIC_INIT(&pa_sync_cbs);
 #endif /* defined(CONFIG_BT_PER_ADV_SYNC) */
 #endif /* defined(CONFIG_BT_EXT_ADV) */
 
+#if defined(CONFIG_BT_SCAN_COALESCE)
+/* Consecutive slots probed for a report before replacing the oldest one */
+#define COALESCE_WAYS MIN(4, CONFIG_BT_SCAN_COALESCE_SIZE)
+
+struct coalesced_report {
+	bt_addr_le_t addr;
+	uint8_t sid;
+	uint8_t adv_type;
+	bool in_use;
+	uint16_t len;
+	uint32_t data_hash;
+	/* Delivery time of the last report, start of the current window */
+	uint32_t start;
+#if defined(CONFIG_BT_SCAN_COALESCE_RSSI)
+	/* Reports suppressed since the last delivered one */
+	uint16_t reports;
+	int8_t rssi_min;
+	int8_t rssi_max;
+	int32_t rssi_sum;
+#endif /* CONFIG_BT_SCAN_COALESCE_RSSI */
+};
+
+static struct coalesced_report coalesce_table[CONFIG_BT_SCAN_COALESCE_SIZE];
+#endif /* CONFIG_BT_SCAN_COALESCE */
+
 void bt_scan_reset(void)
 {
 	scan_dev_found_cb = NULL;
 #if defined(CONFIG_BT_EXT_ADV)
-	reset_reassembling_advertiser();
+	reset_reassembling_advertisers();
+#endif
+#if defined(CONFIG_BT_SCAN_COALESCE)
+	(void)memset(coalesce_table, 0, sizeof(coalesce_table));
 #endif
 }
 
@@ -431,11 +540,151 @@ static uint8_t get_adv_props_legacy(uint8_t evt_type)
 	}
 }
 
-static void le_adv_recv(bt_addr_le_t *addr, struct bt_le_scan_recv_info *info,
-			struct net_buf_simple *buf, uint16_t len)
+#if defined(CONFIG_BT_SCAN_COALESCE)
+/* 32-bit FNV-1a */
+static uint32_t coalesce_hash(uint32_t hash, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len--) {
+		hash = (hash ^ *p++) * 16777619U;
+	}
+
+	return hash;
+}
+
+#if defined(CONFIG_BT_SCAN_COALESCE_RSSI)
+static void coalesce_rssi(struct coalesced_report *entry,
+			  struct bt_le_scan_recv_info *info)
+{
+	info->reports = entry->reports + 1;
+	info->rssi_min = entry->reports ? MIN(entry->rssi_min, info->rssi) :
+					  info->rssi;
+	info->rssi_max = entry->reports ? MAX(entry->rssi_max, info->rssi) :
+					  info->rssi;
+	info->rssi = (entry->rssi_sum + info->rssi) / info->reports;
+
+	entry->reports = 0U;
+	entry->rssi_sum = 0;
+}
+
+static void coalesce_rssi_add(struct coalesced_report *entry, int8_t rssi)
+{
+	if (!entry->reports) {
+		entry->rssi_min = rssi;
+		entry->rssi_max = rssi;
+	} else {
+		entry->rssi_min = MIN(entry->rssi_min, rssi);
+		entry->rssi_max = MAX(entry->rssi_max, rssi);
+	}
+
+	/* Keep the average meaningful for very long windows */
+	if (entry->reports < UINT16_MAX - 1) {
+		entry->rssi_sum += rssi;
+		entry->reports++;
+	}
+}
+#else
+#define coalesce_rssi(entry, info)
+#define coalesce_rssi_add(entry, rssi)
+#endif /* CONFIG_BT_SCAN_COALESCE_RSSI */
+
+/* Returns false if the same report from the same advertiser was delivered
+ * less than CONFIG_BT_SCAN_COALESCE_WINDOW ago and should be dropped.
+ */
+static bool scan_coalesce(const bt_addr_le_t *addr,
+			  struct bt_le_scan_recv_info *info,
+			  const uint8_t *data, uint16_t len)
+{
+	struct coalesced_report *entry, *victim = NULL;
+	uint32_t now = k_uptime_get_32();
+	uint32_t data_hash, idx;
+	int i;
+
+	data_hash = coalesce_hash(2166136261U, &info->adv_type,
+				  sizeof(info->adv_type));
+	data_hash = coalesce_hash(data_hash, data, len);
+	idx = coalesce_hash(data_hash ^ info->sid, addr, sizeof(*addr));
+
+	for (i = 0; i < COALESCE_WAYS; i++) {
+		entry = &coalesce_table[(idx + i) % ARRAY_SIZE(coalesce_table)];
+
+		if (entry->in_use && entry->data_hash == data_hash &&
+		    entry->len == len && entry->sid == info->sid &&
+		    entry->adv_type == info->adv_type &&
+		    !bt_addr_le_cmp(&entry->addr, addr)) {
+			break;
+		}
+
+		if (!entry->in_use) {
+			if (!victim || victim->in_use) {
+				victim = entry;
+			}
+		} else if (!victim ||
+			   (victim->in_use &&
+			    (int32_t)(entry->start - victim->start) < 0)) {
+			victim = entry;
+		}
+	}
+
+	if (i == COALESCE_WAYS) {
+		entry = victim;
+
+		bt_addr_le_copy(&entry->addr, addr);
+		entry->sid = info->sid;
+		entry->adv_type = info->adv_type;
+		entry->len = len;
+		entry->data_hash = data_hash;
+		entry->in_use = true;
+#if defined(CONFIG_BT_SCAN_COALESCE_RSSI)
+		entry->reports = 0U;
+		entry->rssi_sum = 0;
+#endif
+	} else if (now - entry->start < CONFIG_BT_SCAN_COALESCE_WINDOW) {
+		coalesce_rssi_add(entry, info->rssi);
+		return false;
+	}
+
+	coalesce_rssi(entry, info);
+	entry->start = now;
+
+	return true;
+}
+#else
+#define scan_coalesce(addr, info, data, len) true
+#endif /* CONFIG_BT_SCAN_COALESCE */
+
+static void le_adv_notify(const bt_addr_le_t *id_addr,
+			  const struct bt_le_scan_recv_info *info,
+			  struct net_buf_simple *buf, uint16_t len)
 {
 	struct bt_le_scan_cb *listener, *next;
 	struct net_buf_simple_state state;
+
+	if (scan_dev_found_cb) {
+		net_buf_simple_save(buf, &state);
+
+		buf->len = len;
+		scan_dev_found_cb(id_addr, info->rssi, info->adv_type, buf);
+
+		net_buf_simple_restore(buf, &state);
+	}
+
+	SYS_SLIST_FOR_EACH_CONTAINER_SAFE(&scan_cbs, listener, next, node) {
+		if (listener->recv) {
+			net_buf_simple_save(buf, &state);
+
+			buf->len = len;
+			listener->recv(info, buf);
+
+			net_buf_simple_restore(buf, &state);
+		}
+	}
+}
+
+static void le_adv_recv(bt_addr_le_t *addr, struct bt_le_scan_recv_info *info,
+			struct net_buf_simple *buf, uint16_t len)
+{
 	bt_addr_le_t id_addr;
 
 	BT_DBG("%s event %u, len %u, rssi %d dBm", bt_addr_le_str(addr),
@@ -462,24 +711,8 @@ static void le_adv_recv(bt_addr_le_t *addr, struct bt_le_scan_recv_info *info,
 
 	info->addr = &id_addr;
 
-	if (scan_dev_found_cb) {
-		net_buf_simple_save(buf, &state);
-
-		buf->len = len;
-		scan_dev_found_cb(&id_addr, info->rssi, info->adv_type, buf);
-
-		net_buf_simple_restore(buf, &state);
-	}
-
-	SYS_SLIST_FOR_EACH_CONTAINER_SAFE(&scan_cbs, listener, next, node) {
-		if (listener->recv) {
-			net_buf_simple_save(buf, &state);
-
-			buf->len = len;
-			listener->recv(info, buf);
-
-			net_buf_simple_restore(buf, &state);
-		}
+	if (scan_coalesce(&id_addr, info, buf->data, len)) {
+		le_adv_notify(&id_addr, info, buf, len);
 	}
 
 #if defined(CONFIG_BT_CENTRAL)
@@ -568,8 +801,40 @@ static void create_ext_adv_info(struct bt_hci_evt_le_ext_advertising_info const
 	scan_info->interval = sys_le16_to_cpu(evt->interval);
 	scan_info->adv_type = get_adv_type(evt->evt_type);
 	scan_info->adv_props = get_adv_props_extended(evt->evt_type);
+#if defined(CONFIG_BT_SCAN_COALESCE_RSSI)
+	/* A single report, unless coalescing merges others into it */
+	scan_info->reports = 1U;
+	scan_info->rssi_min = evt->rssi;
+	scan_info->rssi_max = evt->rssi;
+#endif /* CONFIG_BT_SCAN_COALESCE_RSSI */
 }
 
+#if defined(CONFIG_BT_EXT_SCAN_FRAG_CB)
+static void le_adv_recv_frag(struct bt_hci_evt_le_ext_advertising_info *evt,
+			     struct net_buf_simple *buf, uint8_t data_status)
+{
+	struct bt_le_scan_cb *listener, *next;
+	struct net_buf_simple_state state;
+	struct bt_le_scan_recv_info info;
+
+	create_ext_adv_info(evt, &info);
+	info.addr = &evt->addr;
+
+	SYS_SLIST_FOR_EACH_CONTAINER_SAFE(&scan_cbs, listener, next, node) {
+		if (listener->recv_frag) {
+			net_buf_simple_save(buf, &state);
+
+			buf->len = evt->length;
+			listener->recv_frag(&info, buf, data_status);
+
+			net_buf_simple_restore(buf, &state);
+		}
+	}
+}
+#else
+#define le_adv_recv_frag(evt, buf, data_status)
+#endif /* CONFIG_BT_EXT_SCAN_FRAG_CB */
+
 void bt_hci_le_adv_ext_report(struct net_buf *buf)
 {
 	uint8_t num_reports = net_buf_pull_u8(buf);
@@ -578,11 +843,11 @@ void bt_hci_le_adv_ext_report(struct net_buf *buf)
 
 	while (num_reports--) {
 		struct bt_hci_evt_le_ext_advertising_info *evt;
+		struct fragmented_advertiser *adv;
 		struct bt_le_scan_recv_info scan_info;
 		uint16_t data_status;
 		bool is_report_complete;
 		bool more_to_come;
-		bool is_new_advertiser;
 
 		if (buf->len < sizeof(*evt)) {
 			BT_ERR("Unexpected end of buffer");
@@ -603,11 +868,11 @@ void bt_hci_le_adv_ext_report(struct net_buf *buf)
 			goto cont;
 		}
 
-		is_new_advertiser = reassembling_advertiser.state == FRAG_ADV_INACTIVE ||
-				    !fragmented_advertisers_equal(&reassembling_advertiser,
-								  &evt->addr, evt->sid);
+		le_adv_recv_frag(evt, &buf->b, data_status);
 
-		if (is_new_advertiser && is_report_complete) {
+		adv = get_reassembling_advertiser(&evt->addr, evt->sid);
+
+		if (!adv && is_report_complete) {
 			/* Only advertising report from this advertiser.
 			 * Create event immediately.
 			 */
@@ -616,54 +881,53 @@ void bt_hci_le_adv_ext_report(struct net_buf *buf)
 			goto cont;
 		}
 
-		if (is_new_advertiser && reassembling_advertiser.state == FRAG_ADV_REASSEMBLING) {
-			BT_WARN("Received an incomplete advertising report while reassembling "
-				"advertising reports from a different advertiser. The advertising "
-				"report is discarded and future scan results may be incomplete. "
-				"Interleaving of fragmented advertising reports from different "
-				"advertisers is not yet supported.");
-			goto cont;
-		}
-
 		if (data_status == BT_HCI_LE_ADV_EVT_TYPE_DATA_STATUS_INCOMPLETE) {
 			/* Controller truncated, no more data will come.
 			 * We do not need to keep track of this advertiser.
 			 * Discard this report.
 			 */
-			reset_reassembling_advertiser();
+			if (adv) {
+				reset_reassembling_advertiser(adv);
+			}
 			goto cont;
 		}
 
-		if (is_new_advertiser) {
-			/* We are not reassembling reports from an advertiser and
-			 * this is the first report from the new advertiser.
+		if (!adv) {
+			/* This is the first report from the new advertiser.
 			 * Initialize the new advertiser.
 			 */
-			__ASSERT_NO_MSG(reassembling_advertiser.state == FRAG_ADV_INACTIVE);
-			init_reassembling_advertiser(&evt->addr, evt->sid);
+			adv = init_reassembling_advertiser(&evt->addr, evt->sid);
+			if (!adv) {
+				BT_WARN("Received an incomplete advertising report while "
+					"reassembling reports from %u other advertisers. The "
+					"advertising report is discarded and future scan "
+					"results may be incomplete.",
+					CONFIG_BT_EXT_SCAN_REASSEMBLY_COUNT);
+				goto cont;
+			}
 		}
 
-		if (evt->length + ext_scan_buf.len > ext_scan_buf.size) {
+		if (evt->length + adv->buf.len > adv->buf.size) {
 			/* The report does not fit in the reassemby buffer
 			 * Discard this and future reports from the advertiser.
 			 */
-			reassembling_advertiser.state = FRAG_ADV_DISCARDING;
+			adv->state = FRAG_ADV_DISCARDING;
 		}
 
-		if (reassembling_advertiser.state == FRAG_ADV_DISCARDING) {
+		if (adv->state == FRAG_ADV_DISCARDING) {
 			if (!more_to_come) {
 				/* We do no longer need to keep track of this advertiser as
 				 * all the expected data is received.
 				 */
-				reset_reassembling_advertiser();
+				reset_reassembling_advertiser(adv);
 			}
 			goto cont;
 		}
 
-		net_buf_simple_add_mem(&ext_scan_buf, buf->data, evt->length);
+		net_buf_simple_add_mem(&adv->buf, buf->data, evt->length);
 		if (more_to_come) {
 			/* The controller will send additional reports to be reassembled */
-			continue;
+			goto cont;
 		}
 
 		/* No more data coming from the controller.
@@ -671,10 +935,10 @@ void bt_hci_le_adv_ext_report(struct net_buf *buf)
 		 */
 		__ASSERT_NO_MSG(is_report_complete);
 		create_ext_adv_info(evt, &scan_info);
-		le_adv_recv(&evt->addr, &scan_info, &ext_scan_buf, ext_scan_buf.len);
+		le_adv_recv(&evt->addr, &scan_info, &adv->buf, adv->buf.len);
 
 		/* We do no longer need to keep track of this advertiser. */
-		reset_reassembling_advertiser();
+		reset_reassembling_advertiser(adv);
 
 cont:
 		net_buf_pull(buf, evt->length);
@@ -1140,6 +1404,11 @@ void bt_hci_le_adv_report(struct net_buf *buf)
 
 		adv_info.adv_type = evt->evt_type;
 		adv_info.adv_props = get_adv_props_legacy(evt->evt_type);
+#if defined(CONFIG_BT_SCAN_COALESCE_RSSI)
+		adv_info.reports = 1U;
+		adv_info.rssi_min = adv_info.rssi;
+		adv_info.rssi_max = adv_info.rssi;
+#endif /* CONFIG_BT_SCAN_COALESCE_RSSI */
 
 		le_adv_recv(&evt->addr, &adv_info, &buf->b, evt->length);
 
@@ -136,6 +136,11 @@ static int set(const char *name, size_t len_rd, settings_read_cb read_cb,
 
 	len = settings_name_next(name, &next);
 
+	/* Read directly by the controller capability cache during init */
+	if (!strncmp(name, "hcic", len)) {
+		return 0;
+	}
+
 	if (!strncmp(name, "id", len)) {
 		/* Any previously provided identities supersede flash */
 		if (atomic_test_bit(bt_dev.flags, BT_DEV_PRESET_ID)) {
@@ -1477,6 +1477,7 @@ static uint8_t smp_br_ident_info(struct bt_smp_br *smp, struct net_buf *buf)
 	}
 
 	memcpy(keys->irk.val, req->irk, sizeof(keys->irk.val));
+	bt_keys_rpa_cache_clear();
 
 	atomic_set_bit(smp->allowed_cmds, BT_SMP_CMD_IDENT_ADDR_INFO);
 
@@ -3890,6 +3891,7 @@ static uint8_t smp_ident_info(struct bt_smp *smp, struct net_buf *buf)
 		}
 
 		memcpy(keys->irk.val, req->irk, 16);
+		bt_keys_rpa_cache_clear();
 	}
 
 	atomic_set_bit(smp->allowed_cmds, BT_SMP_CMD_IDENT_ADDR_INFO);
@@ -3958,7 +3960,7 @@ static uint8_t smp_ident_addr_info(struct bt_smp *smp, struct net_buf *buf)
 			 */
 			if (!bt_addr_le_is_identity(&conn->le.dst)) {
 				bt_addr_le_copy(&keys->addr, &req->addr);
-				bt_addr_le_copy(&conn->le.dst, &req->addr);
+				bt_conn_set_dst_le(conn, &req->addr);
 
 				bt_conn_identity_resolved(conn);
 			}